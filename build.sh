@@ -8,12 +8,15 @@
 # Options:
 #   clean/pristine  - Clean build
 #   flash           - Flash after build (J-Link)
+#   router          - Mains-powered router build
+#   awake           - End device with the receiver always on
 
 set -e
 
 BOARD="promicro_nrf52840/nrf52840"
 PRISTINE=""
 DO_FLASH=""
+ROLE_ARGS=""
 
 # Parse options
 for arg in "$@"; do
@@ -24,6 +27,12 @@ for arg in "$@"; do
         flash)
             DO_FLASH="1"
             ;;
+        router)
+            ROLE_ARGS="-DCONFIG_APP_ROLE_ROUTER=y"
+            ;;
+        awake)
+            ROLE_ARGS="-DCONFIG_APP_ROLE_END_DEVICE=y"
+            ;;
     esac
 done
 
@@ -101,6 +110,7 @@ export ZEPHYR_NRF_MODULE_DIR="${SCRIPT_DIR}/deps/nrf"
 # MCUboot enabled for OTA support
 EXTRA_CMAKE_ARGS="-DZEPHYR_NRF_MODULE_DIR=${SCRIPT_DIR}/deps/nrf"
 EXTRA_CMAKE_ARGS="${EXTRA_CMAKE_ARGS} -DSB_CONF_FILE=${SCRIPT_DIR}/firmware/sysbuild_mcuboot.conf"
+EXTRA_CMAKE_ARGS="${EXTRA_CMAKE_ARGS} ${ROLE_ARGS}"
 west build -b "${BOARD}" -d build firmware ${PRISTINE} \
     -- ${EXTRA_CMAKE_ARGS}
 
@@ -0,0 +1,141 @@
+/**
+ * @file light_diagnostics.h
+ * @brief Manufacturer-specific diagnostics cluster for the LED Copper String
+ *
+ * Read-only counters exposed on the light endpoint so field behaviour
+ * (command latency, power state, etc.) can be measured from the
+ * coordinator without a debug probe.
+ */
+
+#ifndef LIGHT_DIAGNOSTICS_H
+#define LIGHT_DIAGNOSTICS_H
+
+#include <zboss_api.h>
+
+/* ==========================================================================
+ * Cluster Definition
+ * ========================================================================== */
+
+/** Manufacturer-specific cluster ID (0xFC00-0xFFFF range) */
+#define ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS                     0xFC00U
+
+/** Cluster revision */
+#define ZB_ZCL_LIGHT_DIAGNOSTICS_CLUSTER_REVISION_DEFAULT       ((zb_uint16_t)0x0001U)
+
+/* No cluster-specific commands, so no init handlers are needed */
+#define ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS_SERVER_ROLE_INIT    (zb_zcl_cluster_init_t)NULL
+#define ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS_CLIENT_ROLE_INIT    (zb_zcl_cluster_init_t)NULL
+
+/* ==========================================================================
+ * Attributes
+ * ========================================================================== */
+
+enum zb_zcl_light_diagnostics_attr_e {
+	/* Command-to-light latency, APS indication to PWM update (microseconds) */
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_COUNT_ID         = 0x0000,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_MIN_ID           = 0x0001,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_AVG_ID           = 0x0002,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_MAX_ID           = 0x0003,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_P99_ID           = 0x0004,
+	/* Average per stage, measured from the APS indication */
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_ZCL_AVG_ID       = 0x0005,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_LEVEL_AVG_ID     = 0x0006,
+	/* Adaptive polling: current interval (ms), fast-poll entries, time not idle (s) */
+	ZB_ZCL_ATTR_LIGHT_DIAG_POLL_INTERVAL_ID         = 0x0010,
+	ZB_ZCL_ATTR_LIGHT_DIAG_POLL_FAST_ENTRIES_ID     = 0x0011,
+	ZB_ZCL_ATTR_LIGHT_DIAG_POLL_FAST_TIME_ID        = 0x0012,
+	/* Modelled energy per consumer since boot (mWh), and average per day */
+	ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_LED_ID            = 0x0020,
+	ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_MCU_ID            = 0x0021,
+	ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_RADIO_ID          = 0x0022,
+	ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_PER_DAY_ID        = 0x0023,
+	/* Residency: time asleep (0.1 %), wakeups per hour, PM state entries */
+	ZB_ZCL_ATTR_LIGHT_DIAG_PROF_SLEEP_ID            = 0x0030,
+	ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUP_RATE_ID      = 0x0031,
+	ZB_ZCL_ATTR_LIGHT_DIAG_PROF_PM_ENTRIES_ID       = 0x0032,
+	/* Per wakeup source: count and total active time (us), base + source */
+	ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID          = 0x0040,
+	ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID           = 0x0050,
+	/* Work queues: queueing delay max/avg (us) and unused stack (bytes) */
+	ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_LATENCY_MAX_ID  = 0x0060,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_LATENCY_AVG_ID  = 0x0061,
+	ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_STACK_UNUSED_ID = 0x0062,
+	ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_LATENCY_MAX_ID     = 0x0063,
+	ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_LATENCY_AVG_ID     = 0x0064,
+	ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_STACK_UNUSED_ID    = 0x0065,
+	/* Light command queue: fades merged into a later one, commands dropped */
+	ZB_ZCL_ATTR_LIGHT_DIAG_CMD_COALESCED_ID         = 0x0070,
+	ZB_ZCL_ATTR_LIGHT_DIAG_CMD_DROPPED_ID           = 0x0071,
+	/* Batched reporting: Report Attributes frames sent, attributes carried */
+	ZB_ZCL_ATTR_LIGHT_DIAG_REPORT_FRAMES_ID         = 0x0072,
+	ZB_ZCL_ATTR_LIGHT_DIAG_REPORT_ATTRS_ID          = 0x0073,
+	/* OTA download: throughput (bytes/s), time left (s), bytes received */
+	ZB_ZCL_ATTR_LIGHT_DIAG_OTA_RATE_ID              = 0x0080,
+	ZB_ZCL_ATTR_LIGHT_DIAG_OTA_ETA_ID               = 0x0081,
+	ZB_ZCL_ATTR_LIGHT_DIAG_OTA_OFFSET_ID            = 0x0082,
+	/* Per cached group, base + slot: group ID, commands, latency avg/max (us) */
+	ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_ADDR_ID            = 0x0090,
+	ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_CMDS_ID            = 0x00A0,
+	ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_LATENCY_AVG_ID     = 0x00B0,
+	ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_LATENCY_MAX_ID     = 0x00C0,
+};
+
+/** Number of wakeup sources tracked by the residency profiler */
+#define LIGHT_DIAG_PROF_SOURCES                         8
+
+/** Number of group cache slots exposed, unused slots read 0xFFFF */
+#define LIGHT_DIAG_GROUP_SLOTS                          8
+
+/**
+ * Attribute descriptor for a read-only diagnostics counter.
+ */
+#define ZB_LIGHT_DIAG_ATTR_DESC(attr_id, attr_type, data_ptr)  \
+{                                                               \
+	(attr_id),                                              \
+	(attr_type),                                            \
+	ZB_ZCL_ATTR_ACCESS_READ_ONLY,                           \
+	(ZB_ZCL_NON_MANUFACTURER_SPECIFIC),                     \
+	(void *)(data_ptr)                                      \
+}
+
+/** Diagnostics attribute storage */
+typedef struct {
+	zb_uint32_t latency_count;
+	zb_uint32_t latency_min_us;
+	zb_uint32_t latency_avg_us;
+	zb_uint32_t latency_max_us;
+	zb_uint32_t latency_p99_us;
+	zb_uint32_t latency_zcl_avg_us;
+	zb_uint32_t latency_level_avg_us;
+	zb_uint32_t poll_interval_ms;
+	zb_uint32_t poll_fast_entries;
+	zb_uint32_t poll_fast_time_s;
+	zb_uint32_t energy_led_mwh;
+	zb_uint32_t energy_mcu_mwh;
+	zb_uint32_t energy_radio_mwh;
+	zb_uint32_t energy_per_day_mwh;
+	zb_uint16_t prof_sleep_permille;
+	zb_uint32_t prof_wakeups_per_hour;
+	zb_uint32_t prof_pm_entries;
+	zb_uint32_t prof_wakeups[LIGHT_DIAG_PROF_SOURCES];
+	zb_uint32_t prof_active_us[LIGHT_DIAG_PROF_SOURCES];
+	zb_uint32_t light_wq_latency_max_us;
+	zb_uint32_t light_wq_latency_avg_us;
+	zb_uint32_t light_wq_stack_unused;
+	zb_uint32_t io_wq_latency_max_us;
+	zb_uint32_t io_wq_latency_avg_us;
+	zb_uint32_t io_wq_stack_unused;
+	zb_uint32_t cmd_coalesced;
+	zb_uint32_t cmd_dropped;
+	zb_uint32_t report_frames;
+	zb_uint32_t report_attrs;
+	zb_uint32_t ota_rate_bps;
+	zb_uint32_t ota_eta_s;
+	zb_uint32_t ota_offset;
+	zb_uint16_t group_addr[LIGHT_DIAG_GROUP_SLOTS];
+	zb_uint32_t group_cmds[LIGHT_DIAG_GROUP_SLOTS];
+	zb_uint32_t group_latency_avg_us[LIGHT_DIAG_GROUP_SLOTS];
+	zb_uint32_t group_latency_max_us[LIGHT_DIAG_GROUP_SLOTS];
+} light_diag_attrs_t;
+
+#endif /* LIGHT_DIAGNOSTICS_H */
@@ -103,8 +103,7 @@
  * Button Configuration
  * ========================================================================== */
 
-#define BUTTON_LONG_PRESS_THRESHOLD_MS  3000U
-#define BUTTON_DEBOUNCE_TIME_MS         50U
+/* Button timings (debounce, gestures, reset hold) are the BUTTON_* defines in main.c */
 
 /* ==========================================================================
  * Network Configuration
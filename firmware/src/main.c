@@ -14,6 +14,8 @@
  * - STANDBY: P0.24 (HIGH=active, LOW=standby)
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <zephyr/types.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
@@ -22,8 +24,25 @@
 #include <zephyr/drivers/adc.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
 #include <hal/nrf_saadc.h>
 
+#ifdef CONFIG_APP_POWER_SOURCE_DETECT
+#include <nrfx_power.h>
+#endif
+
+#ifdef CONFIG_APP_BATTERY_GUARD
+#include <zephyr/sys/poweroff.h>
+#endif
+
+#ifdef CONFIG_PM
+#include <zephyr/pm/pm.h>
+#endif
+
+#ifdef CONFIG_APP_PROFILER
+#include <zephyr/timing/timing.h>
+#endif
+
 #include <zboss_api.h>
 #include <zboss_api_addons.h>
 #include <zb_mem_config_med.h>
@@ -31,7 +50,10 @@
 #include <zigbee/zigbee_error_handler.h>
 #include <zb_nrf_platform.h>
 #include <zcl/zb_zcl_power_config.h>
+#include <zcl/zb_zcl_poll_control.h>
+#include <zcl/zb_zcl_metering.h>
 #include "zb_dimmable_light.h"
+#include "light_diagnostics.h"
 
 #ifdef CONFIG_ZIGBEE_FOTA
 #include <zigbee/zigbee_fota.h>
@@ -46,6 +68,7 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
  * ========================================================================== */
 
 #define LIGHT_ENDPOINT                  1
+#define SWITCH_ENDPOINT                 2       /* On/Off + Level clients for bound lights */
 
 #define BULB_INIT_BASIC_APP_VERSION     1
 #define BULB_INIT_BASIC_STACK_VERSION   1
@@ -56,7 +79,23 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
 #define BULB_INIT_BASIC_LOCATION_DESC   ""
 #define BULB_INIT_BASIC_PH_ENV          ZB_ZCL_BASIC_ENV_UNSPECIFIED
 
-#define BUTTON_LONG_PRESS_MS            3000
+/* Button gestures */
+#ifdef CONFIG_APP_BUTTON_CLICK_GAP_MS
+#define BUTTON_CLICK_GAP_MS             CONFIG_APP_BUTTON_CLICK_GAP_MS
+#define BUTTON_HOLD_MS                  CONFIG_APP_BUTTON_HOLD_MS
+#define BUTTON_RAMP_RATE                CONFIG_APP_BUTTON_RAMP_RATE
+#define BUTTON_DEBOUNCE_TIME_MS         CONFIG_APP_BUTTON_DEBOUNCE_MS
+#else
+#define BUTTON_CLICK_GAP_MS             300U    /* Max gap inside a multi-click */
+#define BUTTON_HOLD_MS                  500U    /* Press longer than this is a hold */
+#define BUTTON_RAMP_RATE                128U    /* Hold-to-dim, level units per second */
+#define BUTTON_DEBOUNCE_TIME_MS         50U     /* Contact settle time before re-sampling */
+#endif
+#define BUTTON_RESET_HOLD_MS            10000U
+
+/* OTA download: fast poll held this long after each block, rate window */
+#define OTA_POLL_HOLD_MS                30000U
+#define OTA_RATE_WINDOW_MS              5000U
 
 /* Startup behavior values for On/Off cluster */
 #define ZB_ZCL_ON_OFF_STARTUP_OFF       0x00
@@ -75,6 +114,17 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
 #define POLARITY_PERIOD_US              10000U  /* 100Hz default */
 #endif
 
+/*
+ * Device role (CONFIG_APP_ROLE_*). Routers are mains (USB) powered: no
+ * polling, no battery. Always-on end devices keep the receiver on but still
+ * run from the battery. Sleepy end devices (default) do both.
+ */
+#if defined(CONFIG_APP_ROLE_ROUTER)
+#define LIGHT_ROLE_ROUTER               1
+#elif !defined(CONFIG_APP_ROLE_END_DEVICE)
+#define LIGHT_ROLE_SLEEPY               1
+#endif
+
 /* Battery measurement configuration */
 #ifdef CONFIG_APP_BATTERY_REPORT_INTERVAL_SEC
 #define BATTERY_REPORT_INTERVAL_SEC     CONFIG_APP_BATTERY_REPORT_INTERVAL_SEC
@@ -82,6 +132,75 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
 #define BATTERY_REPORT_INTERVAL_SEC     3600U   /* 1 hour default */
 #endif
 
+#ifdef CONFIG_APP_BATTERY_SAMPLE_INTERVAL_SEC
+#define BATTERY_SAMPLE_INTERVAL_SEC     CONFIG_APP_BATTERY_SAMPLE_INTERVAL_SEC
+#else
+#define BATTERY_SAMPLE_INTERVAL_SEC     300U
+#endif
+
+/* Reportable change: voltage in 100mV units, percentage in 0.5% units */
+#ifdef CONFIG_APP_BATTERY_REPORT_VOLTAGE_DELTA
+#define BATTERY_REPORT_VOLTAGE_DELTA    CONFIG_APP_BATTERY_REPORT_VOLTAGE_DELTA
+#else
+#define BATTERY_REPORT_VOLTAGE_DELTA    1U
+#endif
+
+#ifdef CONFIG_APP_BATTERY_REPORT_PERCENT_DELTA
+#define BATTERY_REPORT_PERCENT_DELTA    CONFIG_APP_BATTERY_REPORT_PERCENT_DELTA
+#else
+#define BATTERY_REPORT_PERCENT_DELTA    4U
+#endif
+
+#define BATTERY_REPORT_MIN_INTERVAL_SEC 60U
+
+/* Adaptive sleepy end device poll interval bounds */
+#ifdef CONFIG_APP_POLL_FAST_INTERVAL_MS
+#define POLL_FAST_INTERVAL_MS           CONFIG_APP_POLL_FAST_INTERVAL_MS
+#else
+#define POLL_FAST_INTERVAL_MS           250U
+#endif
+
+#ifdef CONFIG_APP_POLL_LONG_INTERVAL_MS
+#define POLL_LONG_INTERVAL_MS           CONFIG_APP_POLL_LONG_INTERVAL_MS
+#else
+#define POLL_LONG_INTERVAL_MS           30000U
+#endif
+
+#ifdef CONFIG_APP_POLL_FAST_WINDOW_MS
+#define POLL_FAST_WINDOW_MS             CONFIG_APP_POLL_FAST_WINDOW_MS
+#else
+#define POLL_FAST_WINDOW_MS             5000U
+#endif
+
+#ifdef CONFIG_APP_POLL_CHECKIN_INTERVAL_SEC
+#define POLL_CHECKIN_INTERVAL_SEC       CONFIG_APP_POLL_CHECKIN_INTERVAL_SEC
+#else
+#define POLL_CHECKIN_INTERVAL_SEC       3600U
+#endif
+
+/* Polls spent at each backoff step before doubling the interval */
+#define POLL_BACKOFF_POLLS              4U
+
+/* Battery model for state-of-charge estimation */
+#ifdef CONFIG_APP_BATTERY_CAPACITY_MAH
+#define BATTERY_CAPACITY_MAH            CONFIG_APP_BATTERY_CAPACITY_MAH
+#else
+#define BATTERY_CAPACITY_MAH            1000U
+#endif
+
+#ifdef CONFIG_APP_LED_FULL_LOAD_MA
+#define LED_FULL_LOAD_MA                CONFIG_APP_LED_FULL_LOAD_MA
+#else
+#define LED_FULL_LOAD_MA                200U
+#endif
+
+/* SAADC hardware oversampling: 2^N conversions averaged per reading */
+#define BATTERY_ADC_CHANNEL             0
+#define BATTERY_ADC_OVERSAMPLING        4U      /* 16 conversions, ~0.7 ms */
+
+/* Battery voltage EMA weight: alpha = 1 / 2^N */
+#define BATTERY_EMA_SHIFT               2U
+
 /* Battery endpoint - use same endpoint as light for simplicity */
 #define BATTERY_ENDPOINT                LIGHT_ENDPOINT
 
@@ -123,6 +242,29 @@ typedef struct {
 	zb_uint8_t  start_up_current_level; /* Startup level: 0=min, 0xFF=previous, other=specific */
 } level_control_attrs_ext_t;
 
+/* Poll Control cluster attributes (intervals in quarterseconds) */
+typedef struct {
+	zb_uint32_t checkin_interval;
+	zb_uint32_t long_poll_interval;
+	zb_uint16_t short_poll_interval;
+	zb_uint16_t fast_poll_timeout;
+	zb_uint32_t checkin_interval_min;
+	zb_uint32_t long_poll_interval_min;
+	zb_uint16_t fast_poll_timeout_max;
+} poll_control_attrs_t;
+
+/* Simple Metering cluster attributes (modelled energy) */
+typedef struct {
+	zb_uint48_t summation_delivered;      /* mWh, see multiplier/divisor */
+	zb_uint8_t  status;
+	zb_uint8_t  unit_of_measure;
+	zb_uint24_t multiplier;
+	zb_uint24_t divisor;
+	zb_uint8_t  summation_formatting;
+	zb_uint8_t  device_type;
+	zb_int24_t  instantaneous_demand;     /* mW */
+} metering_attrs_t;
+
 /* Power Configuration cluster attributes for battery */
 typedef struct {
 	zb_uint8_t  battery_voltage;          /* In units of 100mV */
@@ -132,6 +274,7 @@ typedef struct {
 	zb_uint8_t  battery_rated_voltage;    /* In units of 100mV */
 	zb_uint8_t  battery_alarm_mask;
 	zb_uint8_t  battery_voltage_min_threshold;
+	zb_uint32_t battery_alarm_state;
 } power_config_attrs_t;
 
 typedef struct {
@@ -141,7 +284,14 @@ typedef struct {
 	zb_zcl_groups_attrs_t        groups_attr;
 	on_off_attrs_ext_t           on_off_attr;
 	level_control_attrs_ext_t    level_control_attr;
+#ifndef LIGHT_ROLE_ROUTER
 	power_config_attrs_t         power_config_attr;
+#endif
+#ifdef LIGHT_ROLE_SLEEPY
+	poll_control_attrs_t         poll_control_attr;
+#endif
+	metering_attrs_t             metering_attr;
+	light_diag_attrs_t           diag_attr;
 } light_device_ctx_t;
 
 static light_device_ctx_t dev_ctx;
@@ -156,188 +306,752 @@ static struct {
 };
 
 static struct gpio_callback button_cb_data;
-static struct k_work button_work;
+static struct k_work_delayable button_work;
 static struct k_work_delayable long_press_work;
 
 /* Effect state */
+#define LIGHT_EFFECT_IDENTIFY           0xF0    /* Private: slow pulse while IdentifyTime runs */
 static struct k_work_delayable effect_work;
 static uint8_t effect_type;
 static uint8_t effect_step;
 
+/* Brightness ceiling imposed by the low battery guardian (255 = none) */
+static uint8_t guard_ceiling = 255;
+
 /* TB6612 polarity alternation state */
 static struct k_timer polarity_timer;
 static volatile bool polarity_phase;  /* false=AIN1 high, true=AIN2 high */
 static volatile bool light_is_on;
+static uint32_t polarity_period_us = POLARITY_PERIOD_US;
+static volatile bool polarity_stop_req;   /* Stop the bridge at the next swap */
+static volatile bool polarity_stopped;    /* Held stopped until released */
+static volatile bool polarity_stop_expired; /* Released by the timer, not the owner */
+static uint8_t polarity_stop_ticks;
+static K_SEM_DEFINE(polarity_stop_sem, 0, 1);
 
+/* Longest the bridge stays stopped for a measurement, in timer ticks (half periods) */
+#define POLARITY_STOP_MAX_TICKS         2U
+
+#ifndef LIGHT_ROLE_ROUTER
 /* Battery measurement state */
 static struct k_work_delayable battery_work;
 static const struct device *adc_dev;
+static uint32_t battery_ema_mv_q4;   /* Filtered voltage, mV << 4, 0 = no sample yet */
+static bool vbus_present;            /* Running from USB, battery reporting suspended */
+#endif
+
+/* Group membership cache (mirrors the ZBOSS group table for this endpoint) */
+#ifdef CONFIG_APP_GROUP_CACHE_SIZE
+#define GROUP_CACHE_SIZE                CONFIG_APP_GROUP_CACHE_SIZE
+#else
+#define GROUP_CACHE_SIZE                8U
+#endif
+
+struct group_stats {
+	uint32_t cmd_count;
+	uint32_t latency_min_us;
+	uint32_t latency_max_us;
+	uint64_t latency_sum_us;
+};
+
+static uint16_t group_ids[GROUP_CACHE_SIZE];
+static struct group_stats group_stats[GROUP_CACHE_SIZE];
+static uint8_t group_count;
+static uint32_t group_filter[256 / 32];  /* One bit per low byte of group ID */
+
+/* Recent groups ZBOSS said we are not in, so foreign traffic stays on the fast path */
+#define GROUP_MISS_CACHE_SIZE           4U
+
+static uint16_t group_miss_ids[GROUP_MISS_CACHE_SIZE];
+static uint8_t group_miss_count;
+static uint8_t group_miss_next;
 
 /* ==========================================================================
- * TB6612 H-Bridge Control
+ * Work Queues - Light control isolated from blocking I/O
  * ========================================================================== */
 
-/**
- * Timer callback for polarity alternation.
- * Switches between AIN1 high and AIN2 high to light both LED halves.
+/*
+ * Fade steps, effects and timed off run on a cooperative queue above the
+ * system workqueue, so they are never delayed by an NVS erase or an ADC
+ * conversion. Settings writes and battery sampling run on a low priority
+ * preemptible queue. Whenever work is queued, a probe item is scheduled
+ * with the same delay (at most once per WQ_PROBE_INTERVAL_MS). It expires
+ * together with the real item, so how late it runs is the delay that item
+ * sees. Stack headroom comes from the thread stack info.
  */
-static void polarity_timer_handler(struct k_timer *timer)
+
+#ifdef CONFIG_APP_LIGHT_WQ_STACK_SIZE
+#define LIGHT_WQ_STACK_SIZE             CONFIG_APP_LIGHT_WQ_STACK_SIZE
+#define LIGHT_WQ_PRIORITY               CONFIG_APP_LIGHT_WQ_PRIORITY
+#define IO_WQ_STACK_SIZE                CONFIG_APP_IO_WQ_STACK_SIZE
+#define IO_WQ_PRIORITY                  CONFIG_APP_IO_WQ_PRIORITY
+#else
+#define LIGHT_WQ_STACK_SIZE             1024
+#define LIGHT_WQ_PRIORITY               -3
+#define IO_WQ_STACK_SIZE                2048
+#define IO_WQ_PRIORITY                  K_PRIO_PREEMPT(10)
+#endif
+
+#define WQ_PROBE_INTERVAL_MS            1000U
+
+struct wq_stats {
+	struct k_work_delayable probe;
+	uint32_t probe_due;             /* Cycle count the probe is due at */
+	uint32_t probe_ms;
+	uint32_t latency_max_us;
+	uint32_t latency_avg_us;        /* EMA, 1/8 weight */
+};
+
+static K_THREAD_STACK_DEFINE(light_wq_stack, LIGHT_WQ_STACK_SIZE);
+static K_THREAD_STACK_DEFINE(io_wq_stack, IO_WQ_STACK_SIZE);
+static struct k_work_q light_wq;
+static struct k_work_q io_wq;
+static struct wq_stats light_wq_stats;
+static struct wq_stats io_wq_stats;
+
+static void wq_probe_handler(struct k_work *work)
 {
-	ARG_UNUSED(timer);
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct wq_stats *st = CONTAINER_OF(dwork, struct wq_stats, probe);
+	int32_t late = (int32_t)(k_cycle_get_32() - st->probe_due);
+	uint32_t us = (late > 0) ? k_cyc_to_us_floor32(late) : 0;
+
+	st->latency_max_us = MAX(st->latency_max_us, us);
+	st->latency_avg_us = st->latency_avg_us ?
+			     st->latency_avg_us - st->latency_avg_us / 8U + us / 8U : us;
+}
 
-	if (!light_is_on) {
+static void wq_probe(struct k_work_q *q, struct wq_stats *st, k_timeout_t delay)
+{
+	uint32_t now = k_uptime_get_32();
+	bool isr = k_is_in_isr();
+
+	if (now - st->probe_ms < WQ_PROBE_INTERVAL_MS || k_work_delayable_busy_get(&st->probe)) {
 		return;
 	}
 
-	polarity_phase = !polarity_phase;
+	st->probe_ms = now;
 
-	if (polarity_phase) {
-		/* Phase B: AIN1=LOW, AIN2=HIGH */
-		gpio_pin_set_dt(&tb6612_ain1, 0);
-		gpio_pin_set_dt(&tb6612_ain2, 1);
-	} else {
-		/* Phase A: AIN1=HIGH, AIN2=LOW */
-		gpio_pin_set_dt(&tb6612_ain1, 1);
-		gpio_pin_set_dt(&tb6612_ain2, 0);
+	/* Keep the queue thread from running the probe before it is stamped */
+	if (!isr) {
+		k_sched_lock();
+	}
+	k_work_schedule_for_queue(q, &st->probe, delay);
+	st->probe_due = K_TIMEOUT_EQ(delay, K_NO_WAIT) ? k_cycle_get_32() :
+		(uint32_t)k_ticks_to_cyc_floor64(k_work_delayable_expires_get(&st->probe));
+	if (!isr) {
+		k_sched_unlock();
 	}
 }
 
-/**
- * Initialize TB6612 GPIO pins.
- */
-static int tb6612_init(void)
+static void light_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay)
 {
-	int ret;
-
-	if (!device_is_ready(tb6612_ain1.port)) {
-		LOG_ERR("TB6612 AIN1 GPIO not ready");
-		return -ENODEV;
-	}
+	k_work_schedule_for_queue(&light_wq, dwork, delay);
+	wq_probe(&light_wq, &light_wq_stats, delay);
+}
 
-	if (!device_is_ready(tb6612_ain2.port)) {
-		LOG_ERR("TB6612 AIN2 GPIO not ready");
-		return -ENODEV;
-	}
+static void light_work_reschedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+	k_work_reschedule_for_queue(&light_wq, dwork, delay);
+	wq_probe(&light_wq, &light_wq_stats, delay);
+}
 
-	if (!device_is_ready(tb6612_standby.port)) {
-		LOG_ERR("TB6612 STANDBY GPIO not ready");
-		return -ENODEV;
-	}
+static void light_work_submit(struct k_work *work)
+{
+	k_work_submit_to_queue(&light_wq, work);
+	wq_probe(&light_wq, &light_wq_stats, K_NO_WAIT);
+}
 
-	ret = gpio_pin_configure_dt(&tb6612_ain1, GPIO_OUTPUT_LOW);
-	if (ret < 0) {
-		LOG_ERR("TB6612 AIN1 config failed: %d", ret);
-		return ret;
-	}
+static void io_work_submit(struct k_work *work)
+{
+	k_work_submit_to_queue(&io_wq, work);
+	wq_probe(&io_wq, &io_wq_stats, K_NO_WAIT);
+}
 
-	ret = gpio_pin_configure_dt(&tb6612_ain2, GPIO_OUTPUT_LOW);
-	if (ret < 0) {
-		LOG_ERR("TB6612 AIN2 config failed: %d", ret);
-		return ret;
-	}
+static void io_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+	k_work_schedule_for_queue(&io_wq, dwork, delay);
+	wq_probe(&io_wq, &io_wq_stats, delay);
+}
 
-	ret = gpio_pin_configure_dt(&tb6612_standby, GPIO_OUTPUT_LOW);
-	if (ret < 0) {
-		LOG_ERR("TB6612 STANDBY config failed: %d", ret);
-		return ret;
-	}
+static void io_work_reschedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+	k_work_reschedule_for_queue(&io_wq, dwork, delay);
+	wq_probe(&io_wq, &io_wq_stats, delay);
+}
 
-	/* Initialize polarity alternation timer */
-	k_timer_init(&polarity_timer, polarity_timer_handler, NULL);
+static uint32_t wq_stack_unused(struct k_work_q *q)
+{
+	size_t unused = 0;
 
-	LOG_INF("TB6612 initialized (AIN1=P0.%u, AIN2=P0.%u, STBY=P0.%u)",
-		tb6612_ain1.pin, tb6612_ain2.pin, tb6612_standby.pin);
+#if defined(CONFIG_THREAD_STACK_INFO) && defined(CONFIG_INIT_STACKS)
+	k_thread_stack_space_get(k_work_queue_thread_get(q), &unused);
+#else
+	ARG_UNUSED(q);
+#endif
 
-	return 0;
+	return unused;
 }
 
 /**
- * Turn on the TB6612 and start polarity alternation.
+ * Copy the queue figures into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
  */
-static void tb6612_on(void)
+static void wq_update_attrs(void)
 {
-	/* Enable standby (active high) */
-	gpio_pin_set_dt(&tb6612_standby, 1);
-
-	/* Start with phase A */
-	polarity_phase = false;
-	gpio_pin_set_dt(&tb6612_ain1, 1);
-	gpio_pin_set_dt(&tb6612_ain2, 0);
+	dev_ctx.diag_attr.light_wq_latency_max_us = light_wq_stats.latency_max_us;
+	dev_ctx.diag_attr.light_wq_latency_avg_us = light_wq_stats.latency_avg_us;
+	dev_ctx.diag_attr.light_wq_stack_unused = wq_stack_unused(&light_wq);
+	dev_ctx.diag_attr.io_wq_latency_max_us = io_wq_stats.latency_max_us;
+	dev_ctx.diag_attr.io_wq_latency_avg_us = io_wq_stats.latency_avg_us;
+	dev_ctx.diag_attr.io_wq_stack_unused = wq_stack_unused(&io_wq);
+}
 
-	light_is_on = true;
+static void wq_init(void)
+{
+	const struct k_work_queue_config light_cfg = { .name = "light_wq" };
+	const struct k_work_queue_config io_cfg = { .name = "io_wq" };
 
-	/* Start polarity alternation timer */
-	k_timer_start(&polarity_timer, K_USEC(POLARITY_PERIOD_US / 2),
-		      K_USEC(POLARITY_PERIOD_US / 2));
+	k_work_init_delayable(&light_wq_stats.probe, wq_probe_handler);
+	k_work_init_delayable(&io_wq_stats.probe, wq_probe_handler);
 
-	LOG_DBG("TB6612 ON, polarity alternation at %u Hz",
-		1000000U / POLARITY_PERIOD_US);
+	k_work_queue_start(&light_wq, light_wq_stack, K_THREAD_STACK_SIZEOF(light_wq_stack),
+			   LIGHT_WQ_PRIORITY, &light_cfg);
+	k_work_queue_start(&io_wq, io_wq_stack, K_THREAD_STACK_SIZEOF(io_wq_stack),
+			   IO_WQ_PRIORITY, &io_cfg);
 }
 
-/**
- * Turn off the TB6612 and stop polarity alternation.
+/* ==========================================================================
+ * Residency Profiler - Wakeups and active time per source
+ * ========================================================================== */
+
+/*
+ * Every periodic source that wakes the CPU brackets its handler with
+ * prof_begin()/prof_end(); runs, active cycles and a log2 run-time histogram
+ * are kept per source. Handlers are timed with the timing API (the DWT CPU
+ * cycle counter), as the 32 kHz kernel cycle counter cannot resolve them.
+ * It only counts while the CPU runs, so a handler that blocks is charged
+ * for its run time alone. ZBOSS runs in its own thread, so its active time comes
+ * from the kernel thread statistics and its wakeups are counted per stack
+ * event. Sleep residency is the idle thread's share of all cycles, and PM
+ * state entries/residency come from a PM notifier.
  */
-static void tb6612_off(void)
+
+enum prof_source {
+	PROF_POLARITY,
+	PROF_TRANSITION,
+	PROF_EFFECT,
+	PROF_BATTERY,
+	PROF_STATUS_LED,
+	PROF_BUTTON,
+	PROF_POLL,
+	PROF_ZBOSS,
+	PROF_SOURCES,
+};
+
+BUILD_ASSERT(PROF_SOURCES == LIGHT_DIAG_PROF_SOURCES, "diagnostics attribute arrays out of sync");
+
+#ifdef CONFIG_APP_PROFILER
+
+#define PROF_HIST_BUCKETS               12      /* <1us, <2us, <4us ... >=1ms */
+
+#ifdef CONFIG_APP_PROFILER_REPORT_SEC
+#define PROF_REPORT_SEC                 CONFIG_APP_PROFILER_REPORT_SEC
+#else
+#define PROF_REPORT_SEC                 3600U
+#endif
+
+struct prof_stats {
+	uint32_t wakeups;
+	uint64_t active_cycles;         /* Timing API cycles */
+	uint32_t hist[PROF_HIST_BUCKETS];
+};
+
+static const char *const prof_source_names[PROF_SOURCES] = {
+	[PROF_POLARITY]   = "polarity",
+	[PROF_TRANSITION] = "transition",
+	[PROF_EFFECT]     = "effect",
+	[PROF_BATTERY]    = "battery",
+	[PROF_STATUS_LED] = "status_led",
+	[PROF_BUTTON]     = "button",
+	[PROF_POLL]       = "poll",
+	[PROF_ZBOSS]      = "zboss",
+};
+
+static struct prof_stats prof_stats[PROF_SOURCES];
+static struct k_work_delayable prof_report_work;
+static k_tid_t prof_zboss_thread;
+
+#ifdef CONFIG_PM
+static uint32_t prof_pm_entries[PM_STATE_COUNT];
+static uint64_t prof_pm_cycles[PM_STATE_COUNT];
+static uint32_t prof_pm_entered_at;
+
+static void prof_pm_state_entry(enum pm_state state)
 {
-	light_is_on = false;
+	prof_pm_entries[state]++;
+	prof_pm_entered_at = k_cycle_get_32();
+}
 
-	/* Stop polarity alternation */
-	k_timer_stop(&polarity_timer);
+static void prof_pm_state_exit(enum pm_state state)
+{
+	prof_pm_cycles[state] += k_cycle_get_32() - prof_pm_entered_at;
+}
 
-	/* Set both AIN pins low (brake mode) */
-	gpio_pin_set_dt(&tb6612_ain1, 0);
-	gpio_pin_set_dt(&tb6612_ain2, 0);
+static struct pm_notifier prof_pm_notifier = {
+	.state_entry = prof_pm_state_entry,
+	.state_exit = prof_pm_state_exit,
+};
+#endif
 
-	/* Disable standby for power saving */
-	gpio_pin_set_dt(&tb6612_standby, 0);
+static inline uint32_t prof_begin(void)
+{
+	return (uint32_t)timing_counter_get();
+}
 
-	LOG_DBG("TB6612 OFF (standby)");
+/* Safe from ISRs; the polarity timer runs in interrupt context */
+static void prof_end(enum prof_source src, uint32_t start)
+{
+	uint32_t cycles = (uint32_t)timing_counter_get() - start;
+	uint32_t us = (uint32_t)(timing_cycles_to_ns(cycles) / 1000U);
+	uint32_t bucket = us ? MIN((uint32_t)LOG2(us) + 1U, PROF_HIST_BUCKETS - 1U) : 0;
+	unsigned int key = irq_lock();
+
+	prof_stats[src].wakeups++;
+	prof_stats[src].active_cycles += cycles;
+	prof_stats[src].hist[bucket]++;
+
+	irq_unlock(key);
 }
 
-/* ==========================================================================
- * Persistent Settings - Save/restore light state across power cycles
- * ========================================================================== */
+/* A ZBOSS stack event (frame or signal); active time comes from the thread */
+static void prof_event(enum prof_source src)
+{
+	unsigned int key = irq_lock();
 
-static int light_settings_set(const char *name, size_t len,
-			      settings_read_cb read_cb, void *cb_arg)
+	prof_stats[src].wakeups++;
+	irq_unlock(key);
+}
+
+static void prof_find_zboss(const struct k_thread *thread, void *user_data)
 {
-	if (!strcmp(name, "on_off")) {
-		if (len != sizeof(dev_ctx.on_off_attr.on_off)) {
-			return -EINVAL;
+	ARG_UNUSED(user_data);
+
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	if (name && strcmp(name, "zboss") == 0) {
+		prof_zboss_thread = (k_tid_t)thread;
+	}
+}
+
+static uint64_t prof_active_us(enum prof_source src)
+{
+	if (src == PROF_ZBOSS) {
+		k_thread_runtime_stats_t stats;
+
+		if (!prof_zboss_thread) {
+			k_thread_foreach_unlocked(prof_find_zboss, NULL);
 		}
-		read_cb(cb_arg, &dev_ctx.on_off_attr.on_off, len);
-		LOG_INF("Restored on_off: %d", dev_ctx.on_off_attr.on_off);
-	} else if (!strcmp(name, "level")) {
-		if (len != sizeof(dev_ctx.level_control_attr.current_level)) {
-			return -EINVAL;
+		if (prof_zboss_thread &&
+		    k_thread_runtime_stats_get(prof_zboss_thread, &stats) == 0) {
+			/* Thread statistics are in kernel cycles */
+			return k_cyc_to_us_floor64(stats.execution_cycles);
 		}
-		read_cb(cb_arg, &dev_ctx.level_control_attr.current_level, len);
-		LOG_INF("Restored level: %d", dev_ctx.level_control_attr.current_level);
 	}
-	return 0;
+
+	return timing_cycles_to_ns(prof_stats[src].active_cycles) / 1000U;
 }
 
-SETTINGS_STATIC_HANDLER_DEFINE(light, "light", NULL, light_settings_set, NULL, NULL);
+/* Idle thread share of all cycles since boot, in permille */
+static uint32_t prof_sleep_permille(void)
+{
+	k_thread_runtime_stats_t stats;
 
-static void save_light_state(void)
+	if (k_thread_runtime_stats_all_get(&stats) != 0 || stats.total_cycles == 0) {
+		return 0;
+	}
+
+	return (uint32_t)(stats.idle_cycles * 1000U / stats.total_cycles);
+}
+
+/**
+ * Copy the counters into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
+ */
+static void prof_update_attrs(void)
 {
-	settings_save_one("light/on_off", &dev_ctx.on_off_attr.on_off,
-			  sizeof(dev_ctx.on_off_attr.on_off));
-	settings_save_one("light/level", &dev_ctx.level_control_attr.current_level,
-			  sizeof(dev_ctx.level_control_attr.current_level));
+	uint32_t total = 0;
+	uint32_t pm_entries = 0;
+	uint64_t hours_x1000 = MAX(k_uptime_get() / 3600U, 1);   /* ms / 3600 */
+
+	for (int i = 0; i < PROF_SOURCES; i++) {
+		dev_ctx.diag_attr.prof_wakeups[i] = prof_stats[i].wakeups;
+		dev_ctx.diag_attr.prof_active_us[i] = (uint32_t)prof_active_us(i);
+		total += prof_stats[i].wakeups;
+	}
+
+#ifdef CONFIG_PM
+	for (int i = 0; i < PM_STATE_COUNT; i++) {
+		pm_entries += prof_pm_entries[i];
+	}
+#endif
+
+	dev_ctx.diag_attr.prof_sleep_permille = prof_sleep_permille();
+	dev_ctx.diag_attr.prof_wakeups_per_hour = (uint32_t)((uint64_t)total * 1000U / hours_x1000);
+	dev_ctx.diag_attr.prof_pm_entries = pm_entries;
 }
 
-/* ==========================================================================
- * Zigbee Cluster Declarations
- * ========================================================================== */
+/**
+ * Log the profile as a table: runs, active time and run-time histogram.
+ */
+static void prof_report(void)
+{
+	LOG_INF("Residency: %u.%u%% asleep, uptime %lld s", prof_sleep_permille() / 10U,
+		prof_sleep_permille() % 10U, k_uptime_get() / 1000);
 
-ZB_ZCL_DECLARE_IDENTIFY_ATTRIB_LIST(
-	identify_attr_list,
-	&dev_ctx.identify_attr.identify_time);
+	for (int i = 0; i < PROF_SOURCES; i++) {
+		const struct prof_stats *st = &prof_stats[i];
 
-ZB_ZCL_DECLARE_GROUPS_ATTRIB_LIST(
-	groups_attr_list,
-	&dev_ctx.groups_attr.name_support);
+		LOG_INF("  %-10s %8u runs %10u us  hist %u %u %u %u %u %u %u %u %u %u %u %u",
+			prof_source_names[i], st->wakeups,
+			(uint32_t)prof_active_us(i),
+			st->hist[0], st->hist[1], st->hist[2], st->hist[3], st->hist[4], st->hist[5],
+			st->hist[6], st->hist[7], st->hist[8], st->hist[9], st->hist[10], st->hist[11]);
+	}
+
+#ifdef CONFIG_PM
+	for (int i = 0; i < PM_STATE_COUNT; i++) {
+		if (prof_pm_entries[i]) {
+			LOG_INF("  PM state %d: %u entries, %u ms", i, prof_pm_entries[i],
+				(uint32_t)k_cyc_to_ms_floor64(prof_pm_cycles[i]));
+		}
+	}
+#endif
+}
+
+static void prof_report_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	prof_report();
+	k_work_schedule(&prof_report_work, K_SECONDS(PROF_REPORT_SEC));
+}
+
+static void prof_init(void)
+{
+	timing_init();
+	timing_start();
+
+#ifdef CONFIG_PM
+	pm_notifier_register(&prof_pm_notifier);
+#endif
+
+	if (PROF_REPORT_SEC > 0) {
+		k_work_init_delayable(&prof_report_work, prof_report_work_handler);
+		k_work_schedule(&prof_report_work, K_SECONDS(PROF_REPORT_SEC));
+	}
+}
+
+#else /* !CONFIG_APP_PROFILER */
+
+static inline uint32_t prof_begin(void)
+{
+	return 0;
+}
+
+static inline void prof_end(enum prof_source src, uint32_t start)
+{
+	ARG_UNUSED(src);
+	ARG_UNUSED(start);
+}
+
+static inline void prof_event(enum prof_source src)
+{
+	ARG_UNUSED(src);
+}
+
+static inline void prof_update_attrs(void)
+{
+}
+
+static inline void prof_init(void)
+{
+}
+
+#endif /* CONFIG_APP_PROFILER */
+
+/* ==========================================================================
+ * TB6612 H-Bridge Control
+ * ========================================================================== */
+
+/**
+ * Switch between AIN1 high and AIN2 high to light both LED halves.
+ */
+static void polarity_step(void)
+{
+	if (!light_is_on) {
+		return;
+	}
+
+	if (polarity_stopped) {
+		if (++polarity_stop_ticks < POLARITY_STOP_MAX_TICKS) {
+			return;
+		}
+		/* The measurement overran (owner preempted?), don't keep the string dark */
+		polarity_stopped = false;
+		polarity_stop_expired = true;
+	}
+
+	if (polarity_stop_req) {
+		/* Stop (both inputs low, outputs high-Z) - unloads the battery */
+		gpio_pin_set_dt(&tb6612_ain1, 0);
+		gpio_pin_set_dt(&tb6612_ain2, 0);
+		polarity_stop_req = false;
+		polarity_stop_ticks = 0;
+		polarity_stopped = true;
+		k_sem_give(&polarity_stop_sem);
+		return;
+	}
+
+	polarity_phase = !polarity_phase;
+
+	if (polarity_phase) {
+		/* Phase B: AIN1=LOW, AIN2=HIGH */
+		gpio_pin_set_dt(&tb6612_ain1, 0);
+		gpio_pin_set_dt(&tb6612_ain2, 1);
+	} else {
+		/* Phase A: AIN1=HIGH, AIN2=LOW */
+		gpio_pin_set_dt(&tb6612_ain1, 1);
+		gpio_pin_set_dt(&tb6612_ain2, 0);
+	}
+}
+
+/**
+ * Timer callback for polarity alternation.
+ */
+static void polarity_timer_handler(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	uint32_t prof = prof_begin();
+
+	polarity_step();
+	prof_end(PROF_POLARITY, prof);
+}
+
+/**
+ * Initialize TB6612 GPIO pins.
+ */
+static int tb6612_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(tb6612_ain1.port)) {
+		LOG_ERR("TB6612 AIN1 GPIO not ready");
+		return -ENODEV;
+	}
+
+	if (!device_is_ready(tb6612_ain2.port)) {
+		LOG_ERR("TB6612 AIN2 GPIO not ready");
+		return -ENODEV;
+	}
+
+	if (!device_is_ready(tb6612_standby.port)) {
+		LOG_ERR("TB6612 STANDBY GPIO not ready");
+		return -ENODEV;
+	}
+
+	ret = gpio_pin_configure_dt(&tb6612_ain1, GPIO_OUTPUT_LOW);
+	if (ret < 0) {
+		LOG_ERR("TB6612 AIN1 config failed: %d", ret);
+		return ret;
+	}
+
+	ret = gpio_pin_configure_dt(&tb6612_ain2, GPIO_OUTPUT_LOW);
+	if (ret < 0) {
+		LOG_ERR("TB6612 AIN2 config failed: %d", ret);
+		return ret;
+	}
+
+	ret = gpio_pin_configure_dt(&tb6612_standby, GPIO_OUTPUT_LOW);
+	if (ret < 0) {
+		LOG_ERR("TB6612 STANDBY config failed: %d", ret);
+		return ret;
+	}
+
+	/* Initialize polarity alternation timer */
+	k_timer_init(&polarity_timer, polarity_timer_handler, NULL);
+
+	LOG_INF("TB6612 initialized (AIN1=P0.%u, AIN2=P0.%u, STBY=P0.%u)",
+		tb6612_ain1.pin, tb6612_ain2.pin, tb6612_standby.pin);
+
+	return 0;
+}
+
+/**
+ * Turn on the TB6612 and start polarity alternation.
+ */
+static void tb6612_on(void)
+{
+	/* Enable standby (active high) */
+	gpio_pin_set_dt(&tb6612_standby, 1);
+
+	/* Start with phase A */
+	polarity_phase = false;
+	polarity_stop_req = false;
+	polarity_stopped = false;
+	gpio_pin_set_dt(&tb6612_ain1, 1);
+	gpio_pin_set_dt(&tb6612_ain2, 0);
+
+	light_is_on = true;
+
+	/* Start polarity alternation timer */
+	k_timer_start(&polarity_timer, K_USEC(polarity_period_us / 2),
+		      K_USEC(polarity_period_us / 2));
+
+	LOG_DBG("TB6612 ON, polarity alternation at %u Hz",
+		1000000U / polarity_period_us);
+}
+
+/**
+ * Change the polarity alternation period, restarting the timer if running.
+ */
+static void tb6612_set_period(uint32_t period_us)
+{
+	if (period_us == polarity_period_us) {
+		return;
+	}
+
+	polarity_period_us = period_us;
+
+	if (light_is_on) {
+		k_timer_start(&polarity_timer, K_USEC(period_us / 2), K_USEC(period_us / 2));
+	}
+
+	LOG_INF("TB6612 polarity alternation at %u Hz", 1000000U / period_us);
+}
+
+/**
+ * Turn off the TB6612 and stop polarity alternation.
+ */
+static void tb6612_off(void)
+{
+	light_is_on = false;
+
+	/* Stop polarity alternation */
+	k_timer_stop(&polarity_timer);
+
+	/* Set both AIN pins low (brake mode) */
+	gpio_pin_set_dt(&tb6612_ain1, 0);
+	gpio_pin_set_dt(&tb6612_ain2, 0);
+
+	/* Disable standby for power saving */
+	gpio_pin_set_dt(&tb6612_standby, 0);
+
+	LOG_DBG("TB6612 OFF (standby)");
+}
+
+/* ==========================================================================
+ * Persistent Settings - Save/restore light state across power cycles
+ * ========================================================================== */
+
+static int light_settings_set(const char *name, size_t len,
+			      settings_read_cb read_cb, void *cb_arg)
+{
+	if (!strcmp(name, "on_off")) {
+		if (len != sizeof(dev_ctx.on_off_attr.on_off)) {
+			return -EINVAL;
+		}
+		read_cb(cb_arg, &dev_ctx.on_off_attr.on_off, len);
+		LOG_INF("Restored on_off: %d", dev_ctx.on_off_attr.on_off);
+	} else if (!strcmp(name, "level")) {
+		if (len != sizeof(dev_ctx.level_control_attr.current_level)) {
+			return -EINVAL;
+		}
+		read_cb(cb_arg, &dev_ctx.level_control_attr.current_level, len);
+		LOG_INF("Restored level: %d", dev_ctx.level_control_attr.current_level);
+	} else if (!strcmp(name, "groups")) {
+		if (len > sizeof(group_ids) || (len % sizeof(group_ids[0])) != 0) {
+			return -EINVAL;
+		}
+		read_cb(cb_arg, group_ids, len);
+		group_count = len / sizeof(group_ids[0]);
+		LOG_INF("Restored %u groups", group_count);
+	}
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(light, "light", NULL, light_settings_set, NULL, NULL);
+
+/*
+ * Flash writes run on the I/O queue, never in the ZBOSS or light context.
+ * The light state is written LIGHT_SAVE_DELAY_MS after the last change, so
+ * a burst of level commands (slider drag) costs a single write.
+ */
+#ifdef CONFIG_APP_LIGHT_SAVE_DELAY_MS
+#define LIGHT_SAVE_DELAY_MS             CONFIG_APP_LIGHT_SAVE_DELAY_MS
+#else
+#define LIGHT_SAVE_DELAY_MS             2000
+#endif
+
+static struct k_work_delayable light_save_work;
+static struct k_work group_save_work;
+
+static void light_save_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	settings_save_one("light/on_off", &dev_ctx.on_off_attr.on_off,
+			  sizeof(dev_ctx.on_off_attr.on_off));
+	settings_save_one("light/level", &dev_ctx.level_control_attr.current_level,
+			  sizeof(dev_ctx.level_control_attr.current_level));
+}
+
+static void group_save_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	settings_save_one("light/groups", group_ids, group_count * sizeof(group_ids[0]));
+}
+
+static void save_light_state(void)
+{
+	io_work_reschedule(&light_save_work, K_MSEC(LIGHT_SAVE_DELAY_MS));
+}
+
+/**
+ * Write pending settings now (e.g. before powering off or rebooting).
+ *
+ * Runs the light state save inline, then drains io_wq so queued scene and
+ * group writes land in flash first. Must not be called from io_wq itself.
+ */
+static void save_light_state_flush(void)
+{
+	struct k_work_sync sync;
+
+	if (k_work_cancel_delayable_sync(&light_save_work, &sync)) {
+		light_save_work_handler(NULL);
+	}
+
+	k_work_queue_drain(&io_wq, false);
+}
+
+static void save_group_cache(void)
+{
+	io_work_submit(&group_save_work);
+}
+
+/* ==========================================================================
+ * Zigbee Cluster Declarations
+ * ========================================================================== */
+
+ZB_ZCL_DECLARE_IDENTIFY_ATTRIB_LIST(
+	identify_attr_list,
+	&dev_ctx.identify_attr.identify_time);
+
+ZB_ZCL_DECLARE_GROUPS_ATTRIB_LIST(
+	groups_attr_list,
+	&dev_ctx.groups_attr.name_support);
 
 ZB_ZCL_DECLARE_SCENES_ATTRIB_LIST(
 	scenes_attr_list,
@@ -391,6 +1105,7 @@ ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_LEVEL_CONTROL_START_UP_CURRENT_LEVEL_ID, (&dev_
 ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_LEVEL_CONTROL_MOVE_STATUS_ID, (&level_control_move_status))
 ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST;
 
+#ifndef LIGHT_ROLE_ROUTER
 /* Power Configuration cluster attribute list for battery (custom to include percentage) */
 ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(power_config_attr_list, ZB_ZCL_POWER_CONFIG)
 ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_ID(&dev_ctx.power_config_attr.battery_voltage, ),
@@ -400,12 +1115,118 @@ ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_QUANTITY_ID(&dev_ctx.pow
 ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_RATED_VOLTAGE_ID(&dev_ctx.power_config_attr.battery_rated_voltage, ),
 ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_ALARM_MASK_ID(&dev_ctx.power_config_attr.battery_alarm_mask, ),
 ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_MIN_THRESHOLD_ID(&dev_ctx.power_config_attr.battery_voltage_min_threshold, ),
+ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_ALARM_STATE_ID(&dev_ctx.power_config_attr.battery_alarm_state, ),
 ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST;
+#endif
 
-/* Custom cluster list with Power Configuration - 7 clusters total */
-zb_zcl_cluster_desc_t light_clusters[] = {
-	ZB_ZCL_CLUSTER_DESC(
-		ZB_ZCL_CLUSTER_ID_IDENTIFY,
+#ifdef LIGHT_ROLE_SLEEPY
+/* Poll Control cluster attribute list */
+ZB_ZCL_DECLARE_POLL_CONTROL_ATTRIB_LIST(
+	poll_control_attr_list,
+	&dev_ctx.poll_control_attr.checkin_interval,
+	&dev_ctx.poll_control_attr.long_poll_interval,
+	&dev_ctx.poll_control_attr.short_poll_interval,
+	&dev_ctx.poll_control_attr.fast_poll_timeout,
+	&dev_ctx.poll_control_attr.checkin_interval_min,
+	&dev_ctx.poll_control_attr.long_poll_interval_min,
+	&dev_ctx.poll_control_attr.fast_poll_timeout_max);
+#endif
+
+/* Simple Metering cluster attribute list */
+ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(metering_attr_list, ZB_ZCL_METERING)
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_CURRENT_SUMMATION_DELIVERED_ID, (&dev_ctx.metering_attr.summation_delivered))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_STATUS_ID, (&dev_ctx.metering_attr.status))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_UNIT_OF_MEASURE_ID, (&dev_ctx.metering_attr.unit_of_measure))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_MULTIPLIER_ID, (&dev_ctx.metering_attr.multiplier))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_DIVISOR_ID, (&dev_ctx.metering_attr.divisor))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_SUMMATION_FORMATTING_ID, (&dev_ctx.metering_attr.summation_formatting))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_METERING_DEVICE_TYPE_ID, (&dev_ctx.metering_attr.device_type))
+ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_METERING_INSTANTANEOUS_DEMAND_ID, (&dev_ctx.metering_attr.instantaneous_demand))
+ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST;
+
+/* Per-slot group counters in the diagnostics cluster */
+#define LIGHT_DIAG_GROUP_ATTRS(n) \
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_ADDR_ID + (n), ZB_ZCL_ATTR_TYPE_U16, &dev_ctx.diag_attr.group_addr[n]), \
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_CMDS_ID + (n), ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.group_cmds[n]), \
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_LATENCY_AVG_ID + (n), ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.group_latency_avg_us[n]), \
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_GROUP_LATENCY_MAX_ID + (n), ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.group_latency_max_us[n])
+
+BUILD_ASSERT(LIGHT_DIAG_GROUP_SLOTS == 8, "LIGHT_DIAG_GROUP_ATTRS list out of sync");
+
+/* Diagnostics cluster attribute list (manufacturer-specific, read-only) */
+ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(light_diag_attr_list, ZB_ZCL_LIGHT_DIAGNOSTICS)
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_COUNT_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_count),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_MIN_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_min_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_AVG_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_avg_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_MAX_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_max_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_P99_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_p99_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_ZCL_AVG_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_zcl_avg_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LATENCY_LEVEL_AVG_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.latency_level_avg_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_POLL_INTERVAL_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.poll_interval_ms),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_POLL_FAST_ENTRIES_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.poll_fast_entries),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_POLL_FAST_TIME_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.poll_fast_time_s),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_LED_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.energy_led_mwh),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_MCU_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.energy_mcu_mwh),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_RADIO_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.energy_radio_mwh),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_ENERGY_PER_DAY_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.energy_per_day_mwh),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_LATENCY_MAX_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.light_wq_latency_max_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_LATENCY_AVG_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.light_wq_latency_avg_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_LIGHT_WQ_STACK_UNUSED_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.light_wq_stack_unused),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_LATENCY_MAX_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.io_wq_latency_max_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_LATENCY_AVG_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.io_wq_latency_avg_us),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_IO_WQ_STACK_UNUSED_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.io_wq_stack_unused),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_CMD_COALESCED_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.cmd_coalesced),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_CMD_DROPPED_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.cmd_dropped),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_REPORT_FRAMES_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.report_frames),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_REPORT_ATTRS_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.report_attrs),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_OTA_RATE_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.ota_rate_bps),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_OTA_ETA_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.ota_eta_s),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_OTA_OFFSET_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.ota_offset),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_SLEEP_ID, ZB_ZCL_ATTR_TYPE_U16, &dev_ctx.diag_attr.prof_sleep_permille),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUP_RATE_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups_per_hour),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_PM_ENTRIES_ID, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_pm_entries),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_POLARITY, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_POLARITY]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_TRANSITION, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_TRANSITION]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_EFFECT, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_EFFECT]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_BATTERY, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_BATTERY]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_STATUS_LED, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_STATUS_LED]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_BUTTON, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_BUTTON]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_POLL, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_POLL]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_WAKEUPS_ID + PROF_ZBOSS, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_wakeups[PROF_ZBOSS]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_POLARITY, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_POLARITY]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_TRANSITION, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_TRANSITION]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_EFFECT, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_EFFECT]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_BATTERY, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_BATTERY]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_STATUS_LED, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_STATUS_LED]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_BUTTON, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_BUTTON]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_POLL, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_POLL]),
+ZB_LIGHT_DIAG_ATTR_DESC(ZB_ZCL_ATTR_LIGHT_DIAG_PROF_ACTIVE_ID + PROF_ZBOSS, ZB_ZCL_ATTR_TYPE_U32, &dev_ctx.diag_attr.prof_active_us[PROF_ZBOSS]),
+LIGHT_DIAG_GROUP_ATTRS(0),
+LIGHT_DIAG_GROUP_ATTRS(1),
+LIGHT_DIAG_GROUP_ATTRS(2),
+LIGHT_DIAG_GROUP_ATTRS(3),
+LIGHT_DIAG_GROUP_ATTRS(4),
+LIGHT_DIAG_GROUP_ATTRS(5),
+LIGHT_DIAG_GROUP_ATTRS(6),
+LIGHT_DIAG_GROUP_ATTRS(7),
+ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST;
+
+/*
+ * Custom cluster list: Power Configuration is left out on routers and Poll
+ * Control on anything but a sleepy end device. LIGHT_IN_CLUSTER_COUNT must
+ * match, it names the simple descriptor type.
+ */
+#if defined(LIGHT_ROLE_ROUTER)
+#define LIGHT_IN_CLUSTER_COUNT          8
+#elif defined(LIGHT_ROLE_SLEEPY)
+#define LIGHT_IN_CLUSTER_COUNT          10
+#else
+#define LIGHT_IN_CLUSTER_COUNT          9
+#endif
+
+zb_zcl_cluster_desc_t light_clusters[] = {
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_IDENTIFY,
 		ZB_ZCL_ARRAY_SIZE(identify_attr_list, zb_zcl_attr_t),
 		(identify_attr_list),
 		ZB_ZCL_CLUSTER_SERVER_ROLE,
@@ -446,6 +1267,7 @@ zb_zcl_cluster_desc_t light_clusters[] = {
 		ZB_ZCL_CLUSTER_SERVER_ROLE,
 		ZB_ZCL_MANUF_CODE_INVALID
 	),
+#ifndef LIGHT_ROLE_ROUTER
 	ZB_ZCL_CLUSTER_DESC(
 		ZB_ZCL_CLUSTER_ID_POWER_CONFIG,
 		ZB_ZCL_ARRAY_SIZE(power_config_attr_list, zb_zcl_attr_t),
@@ -453,18 +1275,42 @@ zb_zcl_cluster_desc_t light_clusters[] = {
 		ZB_ZCL_CLUSTER_SERVER_ROLE,
 		ZB_ZCL_MANUF_CODE_INVALID
 	),
+#endif
+#ifdef LIGHT_ROLE_SLEEPY
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+		ZB_ZCL_ARRAY_SIZE(poll_control_attr_list, zb_zcl_attr_t),
+		(poll_control_attr_list),
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_MANUF_CODE_INVALID
+	),
+#endif
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_METERING,
+		ZB_ZCL_ARRAY_SIZE(metering_attr_list, zb_zcl_attr_t),
+		(metering_attr_list),
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_MANUF_CODE_INVALID
+	),
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS,
+		ZB_ZCL_ARRAY_SIZE(light_diag_attr_list, zb_zcl_attr_t),
+		(light_diag_attr_list),
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_MANUF_CODE_INVALID
+	),
 };
 
-/* Simple descriptor for dimmable light with Power Config (7 in clusters) */
-ZB_DECLARE_SIMPLE_DESC(7, 0);
+/* Simple descriptor for dimmable light (no out clusters) */
+ZB_DECLARE_SIMPLE_DESC(LIGHT_IN_CLUSTER_COUNT, 0);
 
-ZB_AF_SIMPLE_DESC_TYPE(7, 0) simple_desc_light_ep = {
+ZB_AF_SIMPLE_DESC_TYPE(LIGHT_IN_CLUSTER_COUNT, 0) simple_desc_light_ep = {
 	.endpoint = LIGHT_ENDPOINT,
 	.app_profile_id = ZB_AF_HA_PROFILE_ID,
 	.app_device_id = ZB_DIMMABLE_LIGHT_DEVICE_ID,
 	.app_device_version = ZB_DEVICE_VER_DIMMABLE_LIGHT,
 	.reserved = 0,
-	.app_input_cluster_count = 7,
+	.app_input_cluster_count = LIGHT_IN_CLUSTER_COUNT,
 	.app_output_cluster_count = 0,
 	.app_cluster_list = {
 		ZB_ZCL_CLUSTER_ID_BASIC,
@@ -473,12 +1319,23 @@ ZB_AF_SIMPLE_DESC_TYPE(7, 0) simple_desc_light_ep = {
 		ZB_ZCL_CLUSTER_ID_GROUPS,
 		ZB_ZCL_CLUSTER_ID_ON_OFF,
 		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+#ifndef LIGHT_ROLE_ROUTER
 		ZB_ZCL_CLUSTER_ID_POWER_CONFIG,
+#endif
+#ifdef LIGHT_ROLE_SLEEPY
+		ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+#endif
+		ZB_ZCL_CLUSTER_ID_METERING,
+		ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS,
 	}
 };
 
-/* Reporting contexts */
-#define LIGHT_REPORT_ATTR_COUNT (ZB_ZCL_ON_OFF_REPORT_ATTR_COUNT + ZB_ZCL_LEVEL_CONTROL_REPORT_ATTR_COUNT)
+/* Reporting contexts (plus metering summation/demand, and battery voltage/percentage/alarm state on end devices) */
+#ifdef LIGHT_ROLE_ROUTER
+#define LIGHT_REPORT_ATTR_COUNT (ZB_ZCL_ON_OFF_REPORT_ATTR_COUNT + ZB_ZCL_LEVEL_CONTROL_REPORT_ATTR_COUNT + 2)
+#else
+#define LIGHT_REPORT_ATTR_COUNT (ZB_ZCL_ON_OFF_REPORT_ATTR_COUNT + ZB_ZCL_LEVEL_CONTROL_REPORT_ATTR_COUNT + 5)
+#endif
 ZBOSS_DEVICE_DECLARE_REPORTING_CTX(reporting_info_light_ep, LIGHT_REPORT_ATTR_COUNT);
 ZBOSS_DEVICE_DECLARE_LEVEL_CONTROL_CTX(cvc_alarm_info_light_ep, 1);
 
@@ -497,903 +1354,4813 @@ ZB_AF_DECLARE_ENDPOINT_DESC(
 	1,
 	cvc_alarm_info_light_ep);
 
+/*
+ * Switch endpoint: client clusters only, so the button can drive lights
+ * and groups bound to it. Bindings are created by the coordinator (ZDO
+ * Bind Request on this endpoint) and live in the stack's binding table.
+ */
+static zb_zcl_cluster_desc_t switch_clusters[] = {
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_ON_OFF,
+		0,
+		NULL,
+		ZB_ZCL_CLUSTER_CLIENT_ROLE,
+		ZB_ZCL_MANUF_CODE_INVALID
+	),
+	ZB_ZCL_CLUSTER_DESC(
+		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+		0,
+		NULL,
+		ZB_ZCL_CLUSTER_CLIENT_ROLE,
+		ZB_ZCL_MANUF_CODE_INVALID
+	),
+};
+
+#define SWITCH_OUT_CLUSTER_COUNT        2
+
+ZB_DECLARE_SIMPLE_DESC(0, SWITCH_OUT_CLUSTER_COUNT);
+
+ZB_AF_SIMPLE_DESC_TYPE(0, SWITCH_OUT_CLUSTER_COUNT) simple_desc_switch_ep = {
+	.endpoint = SWITCH_ENDPOINT,
+	.app_profile_id = ZB_AF_HA_PROFILE_ID,
+	.app_device_id = ZB_HA_DIMMER_SWITCH_DEVICE_ID,
+	.app_device_version = 0,
+	.reserved = 0,
+	.app_input_cluster_count = 0,
+	.app_output_cluster_count = SWITCH_OUT_CLUSTER_COUNT,
+	.app_cluster_list = {
+		ZB_ZCL_CLUSTER_ID_ON_OFF,
+		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+	}
+};
+
+ZB_AF_DECLARE_ENDPOINT_DESC(
+	switch_ep,
+	SWITCH_ENDPOINT,
+	ZB_AF_HA_PROFILE_ID,
+	0,
+	NULL,
+	ZB_ZCL_ARRAY_SIZE(switch_clusters, zb_zcl_cluster_desc_t),
+	switch_clusters,
+	(zb_af_simple_desc_1_1_t *)&simple_desc_switch_ep,
+	0,
+	NULL,
+	0,
+	NULL);
+
 #ifdef CONFIG_ZIGBEE_FOTA
 extern zb_af_endpoint_desc_t zigbee_fota_client_ep;
 
-ZBOSS_DECLARE_DEVICE_CTX_2_EP(
+ZBOSS_DECLARE_DEVICE_CTX_3_EP(
 	light_ctx,
 	zigbee_fota_client_ep,
-	light_ep);
+	light_ep,
+	switch_ep);
 #else
-ZBOSS_DECLARE_DEVICE_CTX_1_EP(
+ZBOSS_DECLARE_DEVICE_CTX_2_EP(
 	light_ctx,
-	light_ep);
+	light_ep,
+	switch_ep);
 #endif
 
 /* ==========================================================================
- * PWM Light Control
+ * Groups - Membership cache and per-group command latency
  * ========================================================================== */
 
 /*
- * CIE 1931 lightness correction lookup table.
- * Maps linear input (0-255) to perceptually linear PWM output (0-255).
- * Human vision perceives brightness logarithmically, so this table
- * compensates to make dimming feel smooth and linear.
+ * Group-addressed commands are checked against a 256-bit filter keyed on the
+ * low byte of the group ID, then a short linear scan. Misses fall back to the
+ * ZBOSS APS group table once and are learned, so the cache heals itself if it
+ * ever drifts (e.g. first boot after an upgrade). Negative answers are kept
+ * in a small ring so frames for other groups don't hit ZBOSS every time; the
+ * ring is dropped whenever membership may have changed.
  */
-static const uint8_t cie1931_lut[256] = {
-	  0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,
-	  2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,   3,   3,   3,   3,   4,
-	  4,   4,   4,   4,   4,   5,   5,   5,   5,   5,   6,   6,   6,   6,   6,   7,
-	  7,   7,   7,   8,   8,   8,   8,   9,   9,   9,  10,  10,  10,  10,  11,  11,
-	 11,  12,  12,  12,  13,  13,  13,  14,  14,  15,  15,  15,  16,  16,  17,  17,
-	 17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  23,  24,  24,  25,
-	 25,  26,  26,  27,  28,  28,  29,  29,  30,  31,  31,  32,  32,  33,  34,  34,
-	 35,  36,  37,  37,  38,  39,  39,  40,  41,  42,  43,  43,  44,  45,  46,  47,
-	 47,  48,  49,  50,  51,  52,  53,  54,  54,  55,  56,  57,  58,  59,  60,  61,
-	 62,  63,  64,  65,  66,  67,  68,  70,  71,  72,  73,  74,  75,  76,  77,  79,
-	 80,  81,  82,  83,  85,  86,  87,  88,  90,  91,  92,  94,  95,  96,  98,  99,
-	100, 102, 103, 105, 106, 108, 109, 110, 112, 113, 115, 116, 118, 120, 121, 123,
-	124, 126, 128, 129, 131, 132, 134, 136, 138, 139, 141, 143, 145, 146, 148, 150,
-	152, 154, 155, 157, 159, 161, 163, 165, 167, 169, 171, 173, 175, 177, 179, 181,
-	183, 185, 187, 189, 191, 193, 196, 198, 200, 202, 204, 207, 209, 211, 214, 216,
-	218, 220, 223, 225, 228, 230, 232, 235, 237, 240, 242, 245, 247, 250, 252, 255,
-};
 
-/* Track actual PWM brightness for transitions */
-static uint8_t current_brightness;
+static void group_miss_clear(void)
+{
+	group_miss_count = 0;
+	group_miss_next = 0;
+}
 
-static void light_set_brightness(zb_uint8_t brightness)
+static bool group_miss_find(uint16_t group_id)
 {
-	/* Apply CIE 1931 perceptual correction */
-	uint8_t corrected = cie1931_lut[brightness];
+	for (uint8_t i = 0; i < group_miss_count; i++) {
+		if (group_miss_ids[i] == group_id) {
+			return true;
+		}
+	}
 
-	/* Calculate pulse width */
-	uint32_t pulse = (uint64_t)corrected * pwm_brightness.period / 255U;
+	return false;
+}
 
-	if (pwm_set_pulse_dt(&pwm_brightness, pulse)) {
-		LOG_ERR("PWM set failed");
-		return;
+static void group_miss_add(uint16_t group_id)
+{
+	group_miss_ids[group_miss_next] = group_id;
+	group_miss_next = (group_miss_next + 1U) % GROUP_MISS_CACHE_SIZE;
+	if (group_miss_count < GROUP_MISS_CACHE_SIZE) {
+		group_miss_count++;
 	}
+}
 
-	current_brightness = brightness;
+static void group_filter_rebuild(void)
+{
+	group_miss_clear();
+	memset(group_filter, 0, sizeof(group_filter));
 
-	/* Control TB6612 on/off based on brightness */
-	if (brightness > 0 && !light_is_on) {
-		tb6612_on();
-	} else if (brightness == 0 && light_is_on) {
-		tb6612_off();
-	}
+	for (uint8_t i = 0; i < group_count; i++) {
+		uint8_t bit = group_ids[i] & 0xFFU;
 
-	LOG_DBG("Brightness: %u -> %u (pulse: %u)", brightness, corrected, pulse);
+		group_filter[bit / 32] |= BIT(bit % 32);
+	}
 }
 
-/* ==========================================================================
- * Smooth Brightness Transitions
- * ========================================================================== */
+static int group_cache_find(uint16_t group_id)
+{
+	uint8_t bit = group_id & 0xFFU;
 
-#define TRANSITION_STEP_MS 20 /* Update every 20ms for smooth 50Hz */
+	if (!(group_filter[bit / 32] & BIT(bit % 32))) {
+		return -1;
+	}
 
-static struct k_work_delayable transition_work;
-static uint8_t transition_start;
-static uint8_t transition_target;
-static uint16_t transition_elapsed;
-static uint16_t transition_duration;
+	for (uint8_t i = 0; i < group_count; i++) {
+		if (group_ids[i] == group_id) {
+			return i;
+		}
+	}
 
-static void transition_work_handler(struct k_work *work)
+	return -1;
+}
+
+static int group_cache_add(uint16_t group_id)
 {
-	ARG_UNUSED(work);
+	int idx = group_cache_find(group_id);
 
-	transition_elapsed += TRANSITION_STEP_MS;
+	if (idx >= 0) {
+		return idx;
+	}
 
-	if (transition_elapsed >= transition_duration) {
-		/* Transition complete */
-		light_set_brightness(transition_target);
-	} else {
-		/* Linear interpolation (use int32_t to avoid overflow) */
-		int32_t diff = (int32_t)transition_target - (int32_t)transition_start;
-		uint8_t current = transition_start +
-			(diff * (int32_t)transition_elapsed / (int32_t)transition_duration);
-		light_set_brightness(current);
-		k_work_schedule(&transition_work, K_MSEC(TRANSITION_STEP_MS));
+	if (group_count >= GROUP_CACHE_SIZE) {
+		LOG_WRN("Group cache full, 0x%04x not cached", group_id);
+		return -1;
 	}
+
+	idx = group_count++;
+	group_ids[idx] = group_id;
+	memset(&group_stats[idx], 0, sizeof(group_stats[idx]));
+	group_filter_rebuild();
+	save_group_cache();
+
+	LOG_INF("Group 0x%04x cached (%u total)", group_id, group_count);
+	return idx;
 }
 
-static void light_fade_to(uint8_t target, uint16_t duration_ms)
+static void group_cache_remove(uint16_t group_id)
 {
-	/* Cancel any ongoing transition */
-	k_work_cancel_delayable(&transition_work);
+	int idx = group_cache_find(group_id);
 
-	if (duration_ms == 0 || current_brightness == target) {
-		/* Instant change or already at target */
-		light_set_brightness(target);
+	if (idx < 0) {
 		return;
 	}
 
-	/* Start from actual current PWM brightness */
-	transition_start = current_brightness;
-	transition_target = target;
-	transition_elapsed = 0;
-	transition_duration = duration_ms;
+	/* Keep the array dense: move the last entry into the hole */
+	group_count--;
+	group_ids[idx] = group_ids[group_count];
+	group_stats[idx] = group_stats[group_count];
+	group_filter_rebuild();
+	save_group_cache();
 
-	LOG_INF("Fade: %u -> %u over %ums", transition_start, target, duration_ms);
+	LOG_INF("Group 0x%04x removed from cache", group_id);
+}
 
-	/* Start transition */
-	k_work_schedule(&transition_work, K_NO_WAIT);
+static void group_cache_clear(void)
+{
+	group_count = 0;
+	group_filter_rebuild();
+	save_group_cache();
 }
 
-static void level_control_set_value(zb_uint16_t new_level)
+/**
+ * Fast membership test for the light endpoint.
+ */
+static bool group_is_member(uint16_t group_id)
 {
-	LOG_INF("Set level: %u", new_level);
+	if (group_cache_find(group_id) >= 0) {
+		return true;
+	}
 
-	ZB_ZCL_SET_ATTRIBUTE(
-		LIGHT_ENDPOINT,
-		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
-		ZB_ZCL_CLUSTER_SERVER_ROLE,
-		ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
-		(zb_uint8_t *)&new_level,
-		ZB_FALSE);
+	if (group_miss_find(group_id)) {
+		return false;
+	}
 
-	light_set_brightness((zb_uint8_t)new_level);
+	/* Slow path: consult ZBOSS and learn the result */
+	if (zb_aps_is_endpoint_in_group(group_id, LIGHT_ENDPOINT)) {
+		group_cache_add(group_id);
+		return true;
+	}
 
-	if (new_level > 0) {
-		app_state.last_brightness = (uint8_t)new_level;
+	group_miss_add(group_id);
+	return false;
+}
+
+/**
+ * Drop cached groups that ZBOSS did not actually accept (e.g. table full).
+ * Scheduled to run after the Groups cluster command has been processed.
+ */
+static void group_cache_verify(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	for (int i = group_count - 1; i >= 0; i--) {
+		if (!zb_aps_is_endpoint_in_group(group_ids[i], LIGHT_ENDPOINT)) {
+			group_cache_remove(group_ids[i]);
+		}
 	}
+}
 
-	save_light_state();
+/* ==========================================================================
+ * Latency Instrumentation - Command-to-light timing
+ * ========================================================================== */
+
+/*
+ * A light command is stamped when ZBOSS indicates it at the APS layer, then
+ * each later probe (ZCL callback, level set, PWM update) records its offset
+ * from that stamp once. The PWM probe closes the measurement. Values are
+ * kept in a log2 histogram so p99 can be derived without storing samples.
+ * Resolution is that of the system clock (~30 us on nRF52 with the RTC).
+ * Handlers for commands that leave the light alone cancel the measurement;
+ * anything still open after LATENCY_TIMEOUT_MS is discarded as unrelated.
+ */
+
+#define LATENCY_HIST_BUCKETS            24U   /* 1 us .. ~16 s */
+#define LATENCY_TIMEOUT_MS              2000U
+
+enum latency_stage {
+	LATENCY_STAGE_ZCL,      /* zcl_device_cb() entry */
+	LATENCY_STAGE_LEVEL,    /* level_control_set_value() */
+	LATENCY_STAGE_PWM,      /* PWM register update */
+	LATENCY_STAGE_COUNT,
+};
+
+struct latency_stats {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t hist[LATENCY_HIST_BUCKETS];
+};
+
+static struct latency_stats latency_stats[LATENCY_STAGE_COUNT];
+
+/* Command awaiting its first PWM update */
+static volatile uint32_t latency_rx_cycles;
+static volatile bool latency_armed;
+static volatile uint8_t latency_seen;      /* Bitmask of stages already recorded */
+static volatile int8_t latency_group_idx = -1;
+
+/**
+ * Latency probe: light command received at the APS layer.
+ * @param group_idx  Group cache index for group-addressed commands, else -1
+ */
+static void latency_probe_rx(int8_t group_idx)
+{
+	latency_rx_cycles = k_cycle_get_32();
+	latency_group_idx = group_idx;
+	latency_seen = 0;
+	latency_armed = true;
 }
 
-static void on_off_set_value(zb_bool_t on)
+/**
+ * Cancel the pending measurement (command will not touch the light).
+ */
+static void latency_probe_cancel(void)
 {
-	LOG_INF("Set on/off: %s", on ? "ON" : "OFF");
+	latency_armed = false;
+}
 
-	ZB_ZCL_SET_ATTRIBUTE(
-		LIGHT_ENDPOINT,
-		ZB_ZCL_CLUSTER_ID_ON_OFF,
-		ZB_ZCL_CLUSTER_SERVER_ROLE,
-		ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
-		(zb_uint8_t *)&on,
-		ZB_FALSE);
+static void latency_stats_add(struct latency_stats *st, uint32_t us)
+{
+	uint32_t bucket = MIN((uint32_t)LOG2(us | 1U), LATENCY_HIST_BUCKETS - 1);
 
-	if (on) {
-		light_set_brightness(dev_ctx.level_control_attr.current_level);
-	} else {
-		light_set_brightness(0U);
+	if (st->count == 0 || us < st->min_us) {
+		st->min_us = us;
 	}
-
-	save_light_state();
+	if (us > st->max_us) {
+		st->max_us = us;
+	}
+	st->sum_us += us;
+	st->count++;
+	st->hist[bucket]++;
 }
 
-static void light_toggle(void)
+/**
+ * Upper bound of the histogram bucket holding the 99th percentile.
+ */
+static uint32_t latency_stats_p99(const struct latency_stats *st)
 {
-	zb_bool_t new_state = !dev_ctx.on_off_attr.on_off;
-	uint8_t target_level;
+	uint32_t target = st->count - st->count / 100U;
+	uint32_t seen = 0;
 
-	if (new_state) {
-		/* Turning on - use last brightness or default */
-		target_level = (dev_ctx.level_control_attr.current_level > 0) ?
-			dev_ctx.level_control_attr.current_level :
-			app_state.last_brightness;
-		if (target_level == 0) {
-			target_level = 255; /* Default to full if no previous */
+	for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+		seen += st->hist[i];
+		if (seen >= target && seen > 0) {
+			return MIN((2U << i) - 1U, st->max_us);
 		}
-	} else {
-		/* Turning off */
-		target_level = 0;
 	}
 
-	/* Update Zigbee attributes */
-	ZB_ZCL_SET_ATTRIBUTE(
-		LIGHT_ENDPOINT,
-		ZB_ZCL_CLUSTER_ID_ON_OFF,
-		ZB_ZCL_CLUSTER_SERVER_ROLE,
-		ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
-		(zb_uint8_t *)&new_state,
-		ZB_FALSE);
+	return st->max_us;
+}
+
+static void group_stats_add(int8_t idx, uint32_t us)
+{
+	struct group_stats *st = &group_stats[idx];
 
-	if (new_state && target_level != dev_ctx.level_control_attr.current_level) {
-		ZB_ZCL_SET_ATTRIBUTE(
-			LIGHT_ENDPOINT,
-			ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
-			ZB_ZCL_CLUSTER_SERVER_ROLE,
-			ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
-			(zb_uint8_t *)&target_level,
-			ZB_FALSE);
+	if (st->cmd_count == 0 || us < st->latency_min_us) {
+		st->latency_min_us = us;
+	}
+	if (us > st->latency_max_us) {
+		st->latency_max_us = us;
 	}
+	st->latency_sum_us += us;
+	st->cmd_count++;
 
-	/* Smooth fade using configured transition time (convert 1/10s to ms) */
-	uint16_t transition_ms = dev_ctx.level_control_attr.on_off_transition_time * 100;
-	if (transition_ms == 0) {
-		transition_ms = 1000; /* Default 1s if not set */
+	LOG_DBG("Group 0x%04x: %u us (min %u, avg %u, max %u, n=%u)",
+		group_ids[idx], us, st->latency_min_us,
+		(uint32_t)(st->latency_sum_us / st->cmd_count),
+		st->latency_max_us, st->cmd_count);
+}
+
+/**
+ * Copy the per-group figures into the diagnostics attributes.
+ * Slots past the end of the cache read as group 0xFFFF with no commands.
+ */
+static void group_update_attrs(void)
+{
+	light_diag_attrs_t *diag = &dev_ctx.diag_attr;
+
+	for (uint8_t i = 0; i < LIGHT_DIAG_GROUP_SLOTS; i++) {
+		if (i >= group_count) {
+			diag->group_addr[i] = 0xFFFFU;
+			diag->group_cmds[i] = 0;
+			diag->group_latency_avg_us[i] = 0;
+			diag->group_latency_max_us[i] = 0;
+			continue;
+		}
+
+		const struct group_stats *st = &group_stats[i];
+
+		diag->group_addr[i] = group_ids[i];
+		diag->group_cmds[i] = st->cmd_count;
+		diag->group_latency_avg_us[i] = st->cmd_count ?
+			(uint32_t)(st->latency_sum_us / st->cmd_count) : 0;
+		diag->group_latency_max_us[i] = st->latency_max_us;
 	}
-	light_fade_to(target_level, transition_ms);
+}
 
-	if (target_level > 0) {
-		app_state.last_brightness = target_level;
+/**
+ * Latency probe at a processing stage. The PWM stage ends the measurement.
+ */
+static void latency_probe(enum latency_stage stage)
+{
+	if (!latency_armed || (latency_seen & BIT(stage))) {
+		return;
 	}
 
-	/* Persist state for power-on restore */
-	save_light_state();
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - latency_rx_cycles);
 
-	LOG_INF("Toggle: %s (level %u, fade %ums)",
-		new_state ? "ON" : "OFF", target_level, transition_ms);
+	if (us > LATENCY_TIMEOUT_MS * 1000U) {
+		/* The command never reached the light, this update is unrelated */
+		latency_armed = false;
+		return;
+	}
+
+	latency_seen |= BIT(stage);
+	latency_stats_add(&latency_stats[stage], us);
+
+	if (stage == LATENCY_STAGE_PWM) {
+		latency_armed = false;
+		if (latency_group_idx >= 0 && latency_group_idx < group_count) {
+			group_stats_add(latency_group_idx, us);
+		}
+		LOG_DBG("Command-to-light: %u us", us);
+	}
+}
+
+/**
+ * Copy the aggregated figures into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
+ */
+static void latency_update_attrs(void)
+{
+	const struct latency_stats *pwm = &latency_stats[LATENCY_STAGE_PWM];
+	const struct latency_stats *zcl = &latency_stats[LATENCY_STAGE_ZCL];
+	const struct latency_stats *lvl = &latency_stats[LATENCY_STAGE_LEVEL];
+
+	dev_ctx.diag_attr.latency_count = pwm->count;
+	dev_ctx.diag_attr.latency_min_us = pwm->min_us;
+	dev_ctx.diag_attr.latency_avg_us = pwm->count ? (uint32_t)(pwm->sum_us / pwm->count) : 0;
+	dev_ctx.diag_attr.latency_max_us = pwm->max_us;
+	dev_ctx.diag_attr.latency_p99_us = latency_stats_p99(pwm);
+	dev_ctx.diag_attr.latency_zcl_avg_us = zcl->count ? (uint32_t)(zcl->sum_us / zcl->count) : 0;
+	dev_ctx.diag_attr.latency_level_avg_us = lvl->count ? (uint32_t)(lvl->sum_us / lvl->count) : 0;
 }
 
 /* ==========================================================================
- * Identify Effects
+ * Attribute Reporting - One Report Attributes frame per cluster
  * ========================================================================== */
 
-static void effect_work_handler(struct k_work *work)
-{
-	ARG_UNUSED(work);
-
-	switch (effect_type) {
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_BLINK:
-		/* Single blink: on then off */
-		if (effect_step == 0) {
-			light_set_brightness(255);
-			effect_step = 1;
-			k_work_schedule(&effect_work, K_MSEC(500));
-		} else {
-			/* Restore previous state */
-			if (dev_ctx.on_off_attr.on_off) {
-				light_set_brightness(dev_ctx.level_control_attr.current_level);
-			} else {
-				light_set_brightness(0);
-			}
-			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+/*
+ * Local actions usually change several attributes at once (a toggle sets
+ * OnOff and CurrentLevel, a battery sample voltage, percentage and alarm
+ * state). Setting them through ZB_ZCL_SET_ATTRIBUTE makes the ZBOSS
+ * reporting engine send one frame per attribute. Instead, report_set()
+ * writes the value and marks it dirty; REPORT_BATCH_MS later every cluster
+ * with dirty attributes gets a single Report Attributes frame to its
+ * bindings. Only attributes with a reporting configuration are included,
+ * and the configured reportable change is honoured. The sent value is
+ * recorded in the ZBOSS reporting info so its periodic reports stay
+ * consistent. All of this runs in the ZBOSS thread.
+ */
+
+#define REPORT_BATCH_MS                 50U
+
+enum report_attr {
+	REPORT_ON_OFF,
+	REPORT_LEVEL,
+#ifndef LIGHT_ROLE_ROUTER
+	REPORT_BATTERY_VOLTAGE,
+	REPORT_BATTERY_PERCENTAGE,
+	REPORT_BATTERY_ALARM_STATE,
+#endif
+	REPORT_ATTRS,
+};
+
+struct report_attr_desc {
+	zb_uint16_t cluster_id;
+	zb_uint16_t attr_id;
+	zb_uint8_t type;
+	zb_uint8_t size;
+	bool analog;                    /* Subject to the reportable change */
+	void *data;
+};
+
+static const struct report_attr_desc report_attrs[REPORT_ATTRS] = {
+	[REPORT_ON_OFF] = {
+		ZB_ZCL_CLUSTER_ID_ON_OFF, ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+		ZB_ZCL_ATTR_TYPE_BOOL, 1, false, &dev_ctx.on_off_attr.on_off,
+	},
+	[REPORT_LEVEL] = {
+		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+		ZB_ZCL_ATTR_TYPE_U8, 1, true, &dev_ctx.level_control_attr.current_level,
+	},
+#ifndef LIGHT_ROLE_ROUTER
+	[REPORT_BATTERY_VOLTAGE] = {
+		ZB_ZCL_CLUSTER_ID_POWER_CONFIG, ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_ID,
+		ZB_ZCL_ATTR_TYPE_U8, 1, true, &dev_ctx.power_config_attr.battery_voltage,
+	},
+	[REPORT_BATTERY_PERCENTAGE] = {
+		ZB_ZCL_CLUSTER_ID_POWER_CONFIG,
+		ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID,
+		ZB_ZCL_ATTR_TYPE_U8, 1, true, &dev_ctx.power_config_attr.battery_percentage,
+	},
+	[REPORT_BATTERY_ALARM_STATE] = {
+		ZB_ZCL_CLUSTER_ID_POWER_CONFIG, ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_ALARM_STATE_ID,
+		ZB_ZCL_ATTR_TYPE_32BITMAP, 4, false, &dev_ctx.power_config_attr.battery_alarm_state,
+	},
+#endif
+};
+
+static uint32_t report_dirty;           /* Bit per enum report_attr */
+static bool report_flush_pending;
+static uint32_t report_frames;
+static uint32_t report_attrs_sent;
+
+/**
+ * Should this attribute go into the batch?
+ */
+static zb_zcl_reporting_info_t *report_info_due(const struct report_attr_desc *d)
+{
+	zb_zcl_reporting_info_t *rep = zb_zcl_find_reporting_info(
+		LIGHT_ENDPOINT, d->cluster_id, ZB_ZCL_CLUSTER_SERVER_ROLE, d->attr_id);
+
+	if (!rep) {
+		/* Nobody asked for reports */
+		return NULL;
+	}
+
+	if (d->analog) {
+		uint8_t value = *(const uint8_t *)d->data;
+		uint8_t last = rep->u.send_info.reported_value.u8;
+
+		if (abs((int)value - (int)last) < rep->u.send_info.delta.u8) {
+			return NULL;
 		}
-		break;
+	}
 
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_BREATHE:
-		/* Breathe: fade up and down, 15 times over ~15 seconds */
-		if (effect_step < 30) {
-			uint8_t brightness;
-			if (effect_step % 2 == 0) {
-				brightness = 255;
-			} else {
-				brightness = 0;
-			}
-			light_set_brightness(brightness);
-			effect_step++;
-			k_work_schedule(&effect_work, K_MSEC(500));
-		} else {
-			/* Restore previous state */
-			if (dev_ctx.on_off_attr.on_off) {
-				light_set_brightness(dev_ctx.level_control_attr.current_level);
-			} else {
-				light_set_brightness(0);
-			}
-			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+	return rep;
+}
+
+static void report_send(zb_bufid_t bufid, zb_uint16_t cluster_id)
+{
+	zb_uint8_t *cmd_ptr = ZB_ZCL_START_PACKET_REQ(bufid)
+	uint8_t count = 0;
+
+	ZB_ZCL_CONSTRUCT_GENERAL_COMMAND_REQ_FRAME_CONTROL_A(
+		cmd_ptr, ZB_ZCL_FRAME_DIRECTION_TO_CLI,
+		ZB_ZCL_NOT_MANUFACTURER_SPECIFIC, ZB_ZCL_DISABLE_DEFAULT_RESPONSE);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER_REQ(cmd_ptr, ZB_ZCL_GET_SEQ_NUM(),
+					    ZB_ZCL_CMD_REPORT_ATTRIB);
+
+	for (int i = 0; i < REPORT_ATTRS; i++) {
+		const struct report_attr_desc *d = &report_attrs[i];
+		zb_zcl_reporting_info_t *rep;
+
+		if (d->cluster_id != cluster_id || !(report_dirty & BIT(i))) {
+			continue;
 		}
-		break;
 
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_OKAY:
-		/* Okay: two quick flashes */
-		if (effect_step < 4) {
-			uint8_t brightness = (effect_step % 2 == 0) ? 255 : 0;
-			light_set_brightness(brightness);
-			effect_step++;
-			k_work_schedule(&effect_work, K_MSEC(200));
-		} else {
-			/* Restore previous state */
-			if (dev_ctx.on_off_attr.on_off) {
-				light_set_brightness(dev_ctx.level_control_attr.current_level);
-			} else {
-				light_set_brightness(0);
-			}
-			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		report_dirty &= ~BIT(i);
+
+		rep = report_info_due(d);
+		if (!rep) {
+			continue;
 		}
-		break;
 
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_CHANNEL_CHANGE:
-		/* Channel change: bright then dim for 8 seconds */
-		if (effect_step == 0) {
-			light_set_brightness(255);
-			effect_step = 1;
-			k_work_schedule(&effect_work, K_MSEC(500));
-		} else if (effect_step == 1) {
-			light_set_brightness(25);
-			effect_step = 2;
-			k_work_schedule(&effect_work, K_MSEC(7500));
-		} else {
-			/* Restore previous state */
-			if (dev_ctx.on_off_attr.on_off) {
-				light_set_brightness(dev_ctx.level_control_attr.current_level);
-			} else {
-				light_set_brightness(0);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, d->attr_id);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, d->type);
+		ZB_ZCL_PACKET_PUT_DATA_N(cmd_ptr, d->data, d->size);
+
+		memcpy(&rep->u.send_info.reported_value, d->data, d->size);
+		count++;
+	}
+
+	if (count == 0) {
+		zb_buf_free(bufid);
+		return;
+	}
+
+	ZB_ZCL_FINISH_PACKET(bufid, cmd_ptr)
+
+	/* No destination: the APS layer delivers to the cluster's bindings */
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, 0, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+				  0, LIGHT_ENDPOINT, ZB_AF_HA_PROFILE_ID, cluster_id, NULL);
+
+	report_frames++;
+	report_attrs_sent += count;
+	LOG_DBG("Report: cluster 0x%04x, %u attributes", cluster_id, count);
+}
+
+static void report_flush(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	uint32_t pending = report_dirty;
+
+	report_flush_pending = false;
+
+	if (!ZB_JOINED()) {
+		report_dirty = 0;
+		return;
+	}
+
+	/* One buffer per cluster; the sender collects that cluster's attributes */
+	for (int i = 0; i < REPORT_ATTRS; i++) {
+		uint16_t cluster_id = report_attrs[i].cluster_id;
+
+		if (!(pending & BIT(i))) {
+			continue;
+		}
+
+		for (int j = i; j < REPORT_ATTRS; j++) {
+			if (report_attrs[j].cluster_id == cluster_id) {
+				pending &= ~BIT(j);
 			}
-			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
 		}
-		break;
 
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT:
-	case ZB_ZCL_IDENTIFY_EFFECT_ID_STOP:
-	default:
-		/* Restore previous state */
-		if (dev_ctx.on_off_attr.on_off) {
-			light_set_brightness(dev_ctx.level_control_attr.current_level);
-		} else {
-			light_set_brightness(0);
+		if (zb_buf_get_out_delayed_ext(report_send, cluster_id, 0) != RET_OK) {
+			LOG_WRN("Report: no buffer for cluster 0x%04x", cluster_id);
 		}
-		effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
-		break;
 	}
 }
 
-static void start_identify_effect(uint8_t effect_id)
+/**
+ * Update an attribute and queue it for the next batched report.
+ * ZBOSS thread only.
+ */
+static void report_set(enum report_attr attr, const void *value)
 {
-	LOG_INF("Identify effect: %u", effect_id);
+	const struct report_attr_desc *d = &report_attrs[attr];
 
-	/* Cancel any running effect */
-	k_work_cancel_delayable(&effect_work);
+	if (memcmp(d->data, value, d->size) == 0) {
+		return;
+	}
 
-	effect_type = effect_id;
-	effect_step = 0;
+	memcpy(d->data, value, d->size);
+	report_dirty |= BIT(attr);
 
-	if (effect_id == ZB_ZCL_IDENTIFY_EFFECT_ID_STOP ||
-	    effect_id == ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT) {
-		/* Immediately restore state */
-		if (dev_ctx.on_off_attr.on_off) {
-			light_set_brightness(dev_ctx.level_control_attr.current_level);
-		} else {
-			light_set_brightness(0);
-		}
-	} else {
-		/* Start effect */
-		k_work_schedule(&effect_work, K_NO_WAIT);
+	if (!report_flush_pending) {
+		report_flush_pending = true;
+		ZB_SCHEDULE_APP_ALARM(report_flush, 0,
+				      ZB_MILLISECONDS_TO_BEACON_INTERVAL(REPORT_BATCH_MS));
 	}
 }
 
+/**
+ * Copy the batcher counters into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
+ */
+static void report_update_attrs(void)
+{
+	dev_ctx.diag_attr.report_frames = report_frames;
+	dev_ctx.diag_attr.report_attrs = report_attrs_sent;
+}
+
 /* ==========================================================================
- * Battery Measurement - LiPo via VDDH (nRF52840)
+ * Adaptive Poll Control - Fast polling on activity, exponential backoff
  * ========================================================================== */
 
+#ifdef LIGHT_ROLE_SLEEPY
+
 /*
- * LiPo voltage to percentage lookup table.
- * Based on typical LiPo discharge curve with values in millivolts.
- * Converts VDDH voltage (from ADC) to battery percentage.
- *
- * LiPo characteristics:
- * - Full charge: 4.20V (100%)
- * - Nominal: 3.70V (~50%)
- * - Cutoff: 3.00V (0%) - below this risks damage
+ * Any received command, button press or transition drops the long poll
+ * interval to the fast value for POLL_FAST_WINDOW_MS. After that the
+ * interval doubles every POLL_BACKOFF_POLLS polls until it reaches the long
+ * (idle) interval, where the work item stops rescheduling itself.
  *
- * The discharge curve is non-linear:
- * - Steep drop from 4.2V to ~4.0V
- * - Relatively flat from 4.0V to 3.6V
- * - Gradual drop from 3.6V to 3.3V
- * - Steep drop below 3.3V
+ * The fast and idle bounds are the Poll Control cluster ShortPollInterval
+ * and LongPollInterval attributes, so the coordinator can tune them. It can
+ * also hold fast polling for FastPollTimeout via a Check-in Response.
  */
-struct battery_level_point {
-	uint16_t mv;      /* Voltage in millivolts */
-	uint8_t  percent; /* Percentage (0-100) */
-};
 
-static const struct battery_level_point lipo_discharge_curve[] = {
-	{ 4200, 100 },
-	{ 4150,  95 },
-	{ 4110,  90 },
-	{ 4080,  85 },
-	{ 4020,  80 },
-	{ 3980,  75 },
-	{ 3950,  70 },
-	{ 3910,  65 },
-	{ 3870,  60 },
-	{ 3840,  55 },
-	{ 3800,  50 },
-	{ 3760,  45 },
-	{ 3730,  40 },
-	{ 3690,  35 },
-	{ 3660,  30 },
-	{ 3620,  25 },
-	{ 3580,  20 },
-	{ 3500,  15 },
-	{ 3450,  10 },
-	{ 3300,   5 },
-	{ 3000,   0 },
-};
+#define POLL_QS_TO_MS(qs)               ((uint32_t)(qs) * 250U)
+
+static struct k_work_delayable poll_work;
+static struct k_work_delayable poll_checkin_work;
+static struct k_spinlock poll_lock;
+static uint32_t poll_interval_ms = POLL_LONG_INTERVAL_MS;
+static uint32_t poll_applied_ms;
+static int64_t poll_hold_until;      /* Coordinator requested fast poll deadline, 0 = none */
+static bool poll_started;
+static bool poll_mains;              /* On USB power: never back off past the fast interval */
+static uint8_t poll_idle_shift;      /* Low battery: idle interval = long << shift */
+
+/* Statistics */
+static uint64_t poll_count_milli;    /* Polls sent x1000, modelled from the interval */
+static int64_t poll_interval_since;
+static uint32_t poll_fast_entries;
+static int64_t poll_fast_since;      /* Uptime when we left the long interval, 0 = idle */
+static uint64_t poll_fast_total_ms;
+
+static uint32_t poll_fast_ms(void)
+{
+	return POLL_QS_TO_MS(dev_ctx.poll_control_attr.short_poll_interval);
+}
+
+static uint32_t poll_long_ms(void)
+{
+	return POLL_QS_TO_MS(dev_ctx.poll_control_attr.long_poll_interval);
+}
+
+/* Interval the backoff settles at */
+static uint32_t poll_idle_ms(void)
+{
+	return poll_mains ? poll_fast_ms() : poll_long_ms() << poll_idle_shift;
+}
+
+/**
+ * Push the current interval to the PIM. Runs in the ZBOSS thread.
+ */
+static void poll_apply_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	uint32_t interval = poll_interval_ms;
+
+	if (!poll_started || !ZB_JOINED() || interval == poll_applied_ms) {
+		return;
+	}
+
+	zb_zdo_pim_set_long_poll_interval(interval);
+	poll_applied_ms = interval;
+
+	LOG_DBG("Poll interval: %u ms", interval);
+}
+
+static void poll_set_interval(uint32_t interval)
+{
+	k_spinlock_key_t key = k_spin_lock(&poll_lock);
+	uint32_t previous = poll_interval_ms;
+	uint32_t long_ms = poll_idle_ms();
+	int64_t now = k_uptime_get();
+
+	if (poll_started) {
+		poll_count_milli += (uint64_t)(now - poll_interval_since) * 1000U / previous;
+	}
+	poll_interval_since = now;
+	poll_interval_ms = interval;
+
+	if (previous >= long_ms && interval < long_ms) {
+		poll_fast_entries++;
+		poll_fast_since = k_uptime_get();
+	} else if (previous < long_ms && interval >= long_ms && poll_fast_since) {
+		poll_fast_total_ms += k_uptime_get() - poll_fast_since;
+		poll_fast_since = 0;
+	}
+
+	k_spin_unlock(&poll_lock, key);
+
+	if (interval != previous) {
+		zigbee_schedule_callback(poll_apply_cb, 0);
+	}
+}
+
+static void poll_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	uint32_t long_ms = poll_idle_ms();
+	uint32_t next = MIN(MAX(poll_interval_ms, poll_fast_ms()) * 2U, long_ms);
+
+	poll_hold_until = 0;
+	poll_set_interval(next);
+
+	if (next < long_ms) {
+		k_work_schedule(&poll_work, K_MSEC(next * POLL_BACKOFF_POLLS));
+	}
+
+	prof_end(PROF_POLL, prof);
+}
+
+/**
+ * Poll fast for at least @p duration_ms, then back off.
+ */
+static void poll_fast_for(uint32_t duration_ms)
+{
+	if (!poll_started) {
+		return;
+	}
+
+	int64_t hold_left = poll_hold_until - k_uptime_get();
+
+	if (hold_left > (int64_t)duration_ms) {
+		/* Coordinator asked for a longer fast poll period */
+		duration_ms = (uint32_t)hold_left;
+	}
+
+	if (poll_interval_ms != poll_fast_ms()) {
+		poll_set_interval(poll_fast_ms());
+	}
+
+	k_work_reschedule(&poll_work, K_MSEC(duration_ms));
+}
+
+/**
+ * Report activity: switch to fast polling and restart the fast window.
+ * Safe to call from any thread.
+ */
+static void poll_activity(void)
+{
+	poll_fast_for(POLL_FAST_WINDOW_MS);
+}
+
+/**
+ * Re-read the bounds after the Poll Control attributes changed.
+ */
+static void poll_bounds_changed(void)
+{
+	uint32_t clamped = CLAMP(poll_interval_ms, poll_fast_ms(), poll_idle_ms());
+
+	if (clamped != poll_interval_ms) {
+		poll_set_interval(clamped);
+	}
+
+	if (poll_interval_ms < poll_idle_ms() && !k_work_delayable_is_pending(&poll_work)) {
+		k_work_schedule(&poll_work, K_MSEC(poll_interval_ms * POLL_BACKOFF_POLLS));
+	}
+}
+
+/**
+ * Switch between battery (back off to the long interval) and USB power
+ * (stay at the fast interval).
+ */
+static void poll_set_mains(bool mains)
+{
+	poll_mains = mains;
+
+	if (poll_started) {
+		poll_bounds_changed();
+	}
+}
+
+/**
+ * Stretch the idle interval to save power on a low battery.
+ */
+static void poll_set_idle_shift(uint8_t shift)
+{
+	poll_idle_shift = shift;
+
+	if (poll_started) {
+		poll_bounds_changed();
+	}
+}
+
+/* Poll Control Check-in --------------------------------------------------- */
+
+static void poll_checkin_frame(zb_bufid_t bufid)
+{
+	zb_uint8_t *cmd_ptr = ZB_ZCL_START_PACKET_REQ(bufid)
+
+	ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_REQ_FRAME_CONTROL_A(
+		cmd_ptr, ZB_ZCL_FRAME_DIRECTION_TO_CLI,
+		ZB_ZCL_NOT_MANUFACTURER_SPECIFIC, ZB_ZCL_ENABLE_DEFAULT_RESPONSE);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER_REQ(cmd_ptr, ZB_ZCL_GET_SEQ_NUM(),
+					    ZB_ZCL_CMD_POLL_CONTROL_CHECK_IN_ID);
+	ZB_ZCL_FINISH_PACKET(bufid, cmd_ptr)
+}
+
+/**
+ * Check-in to the bindings failed (usually: no Poll Control client bound).
+ * Fall back to the coordinator, which hosts the client on most networks.
+ */
+static void poll_checkin_sent(zb_bufid_t bufid)
+{
+	zb_zcl_command_send_status_t *st = ZB_BUF_GET_PARAM(bufid, zb_zcl_command_send_status_t);
+
+	if (st->status == RET_OK) {
+		zb_buf_free(bufid);
+		return;
+	}
+
+	poll_checkin_frame(bufid);
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, 0x0000, ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+				  1, LIGHT_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+				  ZB_ZCL_CLUSTER_ID_POLL_CONTROL, NULL);
+
+	LOG_DBG("Poll Control check-in sent to coordinator");
+}
+
+static void poll_checkin_send(zb_bufid_t bufid)
+{
+	poll_checkin_frame(bufid);
+
+	/* No destination: the APS layer delivers to the Poll Control bindings */
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, 0, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+				  0, LIGHT_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+				  ZB_ZCL_CLUSTER_ID_POLL_CONTROL, poll_checkin_sent);
+
+	LOG_DBG("Poll Control check-in sent");
+}
+
+static void poll_checkin_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	if (ZB_JOINED()) {
+		zb_buf_get_out_delayed(poll_checkin_send);
+	}
+}
+
+static void poll_checkin_schedule(void)
+{
+	uint32_t interval_qs = dev_ctx.poll_control_attr.checkin_interval;
+
+	if (!poll_started || interval_qs == 0) {
+		/* Check-in disabled */
+		k_work_cancel_delayable(&poll_checkin_work);
+		return;
+	}
+
+	k_work_reschedule(&poll_checkin_work, K_MSEC(POLL_QS_TO_MS(interval_qs)));
+}
+
+static void poll_checkin_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	/* Stay reachable long enough to pick up the Check-in Response */
+	poll_activity();
+	zigbee_schedule_callback(poll_checkin_cb, 0);
+	poll_checkin_schedule();
+}
+
+/**
+ * Check-in Response: optionally poll fast for the requested timeout.
+ */
+static void poll_checkin_response(bool start_fast_polling, uint16_t timeout_qs)
+{
+	if (!start_fast_polling) {
+		return;
+	}
+
+	if (timeout_qs == 0) {
+		timeout_qs = dev_ctx.poll_control_attr.fast_poll_timeout;
+	}
+
+	uint32_t timeout_ms = POLL_QS_TO_MS(timeout_qs);
+
+	poll_hold_until = k_uptime_get() + timeout_ms;
+	poll_fast_for(timeout_ms);
+
+	LOG_INF("Poll Control: fast poll for %u ms", timeout_ms);
+}
+
+/**
+ * Fast Poll Stop: end a coordinator requested fast poll period early.
+ */
+static zb_uint8_t poll_fast_stop(void)
+{
+	if (!poll_hold_until) {
+		return ZB_ZCL_STATUS_ACTION_DENIED;
+	}
+
+	poll_hold_until = 0;
+	k_work_reschedule(&poll_work, K_NO_WAIT);
+
+	LOG_INF("Poll Control: fast poll stopped");
+	return ZB_ZCL_STATUS_SUCCESS;
+}
+
+/**
+ * Poll Control attribute written. ZBOSS calls the device callback before it
+ * stores the value, so apply the incoming one.
+ */
+static void poll_control_write(const zb_zcl_set_attr_value_param_t *param)
+{
+	poll_control_attrs_t *attr = &dev_ctx.poll_control_attr;
+
+	switch (param->attr_id) {
+	case ZB_ZCL_ATTR_POLL_CONTROL_CHECKIN_INTERVAL_ID:
+		attr->checkin_interval = param->values.data32;
+		poll_checkin_schedule();
+		break;
+	case ZB_ZCL_ATTR_POLL_CONTROL_LONG_POLL_INTERVAL_ID:
+		attr->long_poll_interval = param->values.data32;
+		if (poll_started) {
+			poll_bounds_changed();
+		}
+		break;
+	case ZB_ZCL_ATTR_POLL_CONTROL_SHORT_POLL_INTERVAL_ID:
+		attr->short_poll_interval = param->values.data16;
+		if (poll_started) {
+			poll_bounds_changed();
+		}
+		break;
+	case ZB_ZCL_ATTR_POLL_CONTROL_FAST_POLL_TIMEOUT_ID:
+		attr->fast_poll_timeout = param->values.data16;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Start the controller after joining. Begins in fast mode since a join is
+ * usually followed by interview/configuration traffic.
+ */
+static void poll_controller_start(void)
+{
+	poll_interval_since = k_uptime_get();
+	poll_started = true;
+	poll_applied_ms = 0;
+	poll_activity();
+	zigbee_schedule_callback(poll_apply_cb, 0);
+	poll_checkin_schedule();
+
+	LOG_INF("Adaptive polling: %u ms fast, %u ms idle, %u ms window",
+		poll_fast_ms(), poll_long_ms(), POLL_FAST_WINDOW_MS);
+}
+
+static void poll_update_attrs(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&poll_lock);
+	uint64_t fast_ms = poll_fast_total_ms;
+
+	if (poll_fast_since) {
+		fast_ms += k_uptime_get() - poll_fast_since;
+	}
+
+	dev_ctx.diag_attr.poll_interval_ms = poll_interval_ms;
+	dev_ctx.diag_attr.poll_fast_entries = poll_fast_entries;
+	dev_ctx.diag_attr.poll_fast_time_s = (uint32_t)(fast_ms / 1000U);
+
+	k_spin_unlock(&poll_lock, key);
+}
+
+/**
+ * Number of polls sent since joining (modelled, for energy accounting).
+ */
+static uint32_t poll_count(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&poll_lock);
+	uint64_t milli = poll_count_milli;
+
+	if (poll_started) {
+		milli += (uint64_t)(k_uptime_get() - poll_interval_since) * 1000U / poll_interval_ms;
+	}
+
+	k_spin_unlock(&poll_lock, key);
+
+	return (uint32_t)(milli / 1000U);
+}
+
+#else /* !LIGHT_ROLE_SLEEPY */
+
+/* Receiver is always on, nothing to adapt */
+static void poll_fast_for(uint32_t duration_ms)
+{
+	ARG_UNUSED(duration_ms);
+}
+
+static void poll_activity(void)
+{
+}
+
+static void poll_controller_start(void)
+{
+}
+
+static void poll_update_attrs(void)
+{
+}
+
+static void poll_set_mains(bool mains)
+{
+	ARG_UNUSED(mains);
+}
+
+static void poll_set_idle_shift(uint8_t shift)
+{
+	ARG_UNUSED(shift);
+}
+
+static uint32_t poll_count(void)
+{
+	return 0;
+}
+
+#endif /* LIGHT_ROLE_SLEEPY */
+
+/* ==========================================================================
+ * Energy Accounting - Modelled LED, MCU and radio consumption
+ * ========================================================================== */
+
+/*
+ * Charge is integrated per consumer and converted to energy at the supply
+ * voltage (last battery reading, or USB). Exposed lazily through the Simple
+ * Metering cluster (CurrentSummationDelivered in mWh, InstantaneousDemand in
+ * mW) and per-consumer diagnostics: values are refreshed when read and
+ * every ENERGY_REFRESH_SEC, never per event.
+ *
+ * - LED:   LED_FULL_LOAD_MA x PWM duty, integrated at each PWM change
+ * - MCU:   active CPU time from the kernel thread usage statistics
+ * - Radio: receiver on continuously (router / always-on end device), or
+ *          ENERGY_POLL_RADIO_US per data poll on a sleepy end device,
+ *          plus ENERGY_FRAME_RADIO_US per received frame and its reply
+ */
+
+#define ENERGY_MCU_ACTIVE_UA            3300U   /* 64 MHz, DC/DC, from flash */
+#define ENERGY_MCU_SLEEP_UA             3U      /* System ON, RTC running */
+#define ENERGY_RADIO_UA                 4800U   /* RX or 0 dBm TX, DC/DC */
+#define ENERGY_POLL_RADIO_US            3000U   /* Data request, ACK, RX window */
+#define ENERGY_FRAME_RADIO_US           4000U   /* Frame in plus response out */
+#define ENERGY_REFRESH_SEC              600U
+
+#ifdef LIGHT_ROLE_ROUTER
+#define ENERGY_SUPPLY_MV                5000U   /* USB */
+#else
+#define ENERGY_SUPPLY_MV                3700U   /* Until the first battery reading */
+#endif
+
+#define ENERGY_UAMS_PER_NWH_MV          3600000U  /* uA*ms*mV per nWh */
+
+enum energy_consumer {
+	ENERGY_LED,
+	ENERGY_MCU,
+	ENERGY_RADIO,
+	ENERGY_CONSUMERS,
+};
+
+static struct k_spinlock energy_lock;
+static struct k_work_delayable energy_work;
+static uint32_t energy_led_ua;
+static int64_t energy_led_since;
+static uint64_t energy_led_uams;
+static atomic_t energy_frames;
+static uint16_t energy_supply_mv = ENERGY_SUPPLY_MV;
+
+/* Converted totals, updated in energy_refresh() */
+static uint64_t energy_nwh[ENERGY_CONSUMERS];
+static uint64_t energy_done_uams[ENERGY_CONSUMERS];  /* Charge already converted */
+static uint32_t energy_demand_mw;
+
+static uint32_t led_load_ua(uint8_t duty)
+{
+	return (uint32_t)LED_FULL_LOAD_MA * 1000U * duty / 255U;
+}
+
+/**
+ * Account for a PWM change. Called from light_set_brightness().
+ */
+static void energy_led_update(uint8_t duty)
+{
+	uint32_t load_ua = led_load_ua(duty);
+	k_spinlock_key_t key = k_spin_lock(&energy_lock);
+	int64_t now = k_uptime_get();
+
+	energy_led_uams += (uint64_t)energy_led_ua * (uint64_t)(now - energy_led_since);
+	energy_led_since = now;
+	energy_led_ua = load_ua;
+
+	k_spin_unlock(&energy_lock, key);
+}
+
+/* Any frame addressed to us, from the APS indication hook */
+static void energy_frame(void)
+{
+	atomic_inc(&energy_frames);
+}
+
+static void energy_set_supply_mv(uint16_t mv)
+{
+	energy_supply_mv = mv;
+}
+
+/**
+ * Integrate up to now and convert to energy. Charge is converted
+ * incrementally so supply voltage changes only affect new consumption.
+ */
+static void energy_refresh(void)
+{
+	uint64_t uams[ENERGY_CONSUMERS];
+	int64_t now_ms = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&energy_lock);
+
+	energy_led_uams += (uint64_t)energy_led_ua * (uint64_t)(now_ms - energy_led_since);
+	energy_led_since = now_ms;
+	uams[ENERGY_LED] = energy_led_uams;
+
+	uint32_t led_ua = energy_led_ua;
+
+	k_spin_unlock(&energy_lock, key);
+
+	/* MCU: active at the run current, the rest of the time asleep */
+	struct k_thread_runtime_stats stats;
+	uint64_t active_ms = 0;
+
+	if (k_thread_runtime_stats_all_get(&stats) == 0) {
+		active_ms = k_cyc_to_ms_floor64(stats.execution_cycles - stats.idle_cycles);
+	}
+	active_ms = MIN(active_ms, (uint64_t)now_ms);
+	uams[ENERGY_MCU] = active_ms * ENERGY_MCU_ACTIVE_UA +
+			   ((uint64_t)now_ms - active_ms) * ENERGY_MCU_SLEEP_UA;
+
+	/* Radio */
+	uint64_t radio_us = (uint64_t)atomic_get(&energy_frames) * ENERGY_FRAME_RADIO_US;
+	uint64_t radio_avg_na;  /* Well under 1 uA at long poll intervals */
+
+#ifdef LIGHT_ROLE_SLEEPY
+	radio_us += (uint64_t)poll_count() * ENERGY_POLL_RADIO_US;
+	radio_avg_na = (uint64_t)ENERGY_RADIO_UA * ENERGY_POLL_RADIO_US /
+		       MAX(poll_interval_ms, 1U);
+#else
+	radio_us += (uint64_t)now_ms * 1000U;
+	radio_avg_na = (uint64_t)ENERGY_RADIO_UA * 1000U;
+#endif
+	uams[ENERGY_RADIO] = radio_us / 1000U * ENERGY_RADIO_UA;
+
+	for (int i = 0; i < ENERGY_CONSUMERS; i++) {
+		uint64_t delta = uams[i] - energy_done_uams[i];
+		uint64_t nwh = delta * energy_supply_mv / ENERGY_UAMS_PER_NWH_MV;
+
+		/* Carry the remainder to the next refresh */
+		energy_done_uams[i] += nwh * ENERGY_UAMS_PER_NWH_MV / energy_supply_mv;
+		energy_nwh[i] += nwh;
+	}
+
+	uint64_t mcu_avg_na = now_ms ? uams[ENERGY_MCU] * 1000U / (uint64_t)now_ms : 0;
+	uint64_t total_na = (uint64_t)led_ua * 1000U + mcu_avg_na + radio_avg_na;
+
+	/* nA * mV = fW, rounded to the nearest mW */
+	energy_demand_mw = (total_na * energy_supply_mv + 500000000000ULL) / 1000000000000ULL;
+}
+
+/**
+ * Refresh and copy into the Metering and diagnostics attributes.
+ * Runs in the ZBOSS thread.
+ */
+static void energy_update_attrs(void)
+{
+	energy_refresh();
+
+	uint64_t total_mwh = (energy_nwh[ENERGY_LED] + energy_nwh[ENERGY_MCU] +
+			      energy_nwh[ENERGY_RADIO]) / 1000000U;
+	uint64_t days_x1000 = MAX(k_uptime_get() / 86400U, 1);   /* ms / 86400 */
+	zb_uint48_t summation = {
+		.low = (uint32_t)total_mwh,
+		.high = (uint16_t)(total_mwh >> 32),
+	};
+	zb_int24_t demand = {
+		.low = (uint16_t)energy_demand_mw,
+		.high = (int8_t)(energy_demand_mw >> 16),
+	};
+
+	/* Through ZBOSS so the reporting engine sees the change */
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_METERING,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_METERING_CURRENT_SUMMATION_DELIVERED_ID,
+		(zb_uint8_t *)&summation,
+		ZB_FALSE);
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_METERING,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_METERING_INSTANTANEOUS_DEMAND_ID,
+		(zb_uint8_t *)&demand,
+		ZB_FALSE);
+
+	dev_ctx.diag_attr.energy_led_mwh = (uint32_t)(energy_nwh[ENERGY_LED] / 1000000U);
+	dev_ctx.diag_attr.energy_mcu_mwh = (uint32_t)(energy_nwh[ENERGY_MCU] / 1000000U);
+	dev_ctx.diag_attr.energy_radio_mwh = (uint32_t)(energy_nwh[ENERGY_RADIO] / 1000000U);
+	dev_ctx.diag_attr.energy_per_day_mwh = (uint32_t)(total_mwh * 1000U / days_x1000);
+}
+
+static void energy_refresh_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	energy_update_attrs();
+}
+
+static void energy_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	zigbee_schedule_callback(energy_refresh_cb, 0);
+	k_work_schedule(&energy_work, K_SECONDS(ENERGY_REFRESH_SEC));
+}
+
+/* ==========================================================================
+ * Status LED - Blink codes played from a kernel timer
+ * ========================================================================== */
+
+/*
+ * Each indication is a blink code: a run of short flashes, then a dark pause.
+ * The code is played by a k_timer whose handler only drives the GPIO and
+ * re-arms itself, so nothing occupies the system workqueue, and the timer is
+ * stopped while there is nothing to show. The highest priority active
+ * indication wins. After STATUS_LED_BACKOFF_SEC of the same code the pause
+ * stretches to the sparse interval; a button press restores the full rate.
+ */
+
+#define STATUS_LED_BACKOFF_SEC          300U
+
+enum status_led_indication {
+	STATUS_LED_RESET,               /* Factory reset confirmation, played once */
+	STATUS_LED_OTA,                 /* Image download, 1-4 flashes by progress */
+	STATUS_LED_LOW_BATTERY,
+	STATUS_LED_NOT_JOINED,
+	STATUS_LED_INDICATIONS,
+};
+
+struct status_led_pattern {
+	uint16_t on_ms;
+	uint16_t gap_ms;                /* Dark time between flashes */
+	uint16_t pause_ms;              /* Dark time after the last flash */
+	uint16_t sparse_ms;             /* Pause after the backoff, 0 = none */
+	uint8_t flashes;
+	bool once;
+};
+
+static const struct status_led_pattern status_led_patterns[STATUS_LED_INDICATIONS] = {
+	[STATUS_LED_RESET]       = { .on_ms = 100, .gap_ms = 100, .flashes = 3, .once = true },
+	[STATUS_LED_OTA]         = { .on_ms = 50, .gap_ms = 250, .pause_ms = 1500, .flashes = 1 },
+	[STATUS_LED_LOW_BATTERY] = { .on_ms = 30, .gap_ms = 200, .pause_ms = 10000,
+				     .sparse_ms = 60000, .flashes = 2 },
+	[STATUS_LED_NOT_JOINED]  = { .on_ms = 100, .pause_ms = 900, .sparse_ms = 30000,
+				     .flashes = 1 },
+};
+
+static struct k_timer status_led_timer;
+static atomic_t status_led_active;      /* Bitmap of enum status_led_indication */
+static int status_led_current = -1;
+static uint8_t status_led_step;         /* Even: flash on, odd: dark */
+static uint32_t status_led_since;       /* Start of the current code (ms) */
+static uint8_t status_led_ota_flashes = 1;
+
+/**
+ * Switch to the highest priority active code, if it changed.
+ * Called from the timer handler or with interrupts locked.
+ */
+static void status_led_select(void)
+{
+	atomic_val_t active = atomic_get(&status_led_active);
+	int next = active ? (int)find_lsb_set(active) - 1 : -1;
+
+	if (next == status_led_current) {
+		return;
+	}
+
+	status_led_current = next;
+	status_led_step = 0;
+	status_led_since = k_uptime_get_32();
+	gpio_pin_set_dt(&status_led, 0);
+
+	if (next < 0) {
+		k_timer_stop(&status_led_timer);
+	} else {
+		k_timer_start(&status_led_timer, K_NO_WAIT, K_NO_WAIT);
+	}
+}
+
+static void status_led_timer_handler(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	const struct status_led_pattern *p;
+	uint8_t flashes;
+	uint32_t wait_ms;
+	uint32_t prof;
+
+	if (status_led_current < 0) {
+		return;
+	}
+
+	prof = prof_begin();
+	p = &status_led_patterns[status_led_current];
+	flashes = (status_led_current == STATUS_LED_OTA) ? status_led_ota_flashes : p->flashes;
+
+	gpio_pin_set_dt(&status_led, (status_led_step & 1U) == 0);
+	status_led_step++;
+
+	if (status_led_step & 1U) {
+		wait_ms = p->on_ms;
+	} else if (status_led_step < 2U * flashes) {
+		wait_ms = p->gap_ms;
+	} else {
+		status_led_step = 0;
+		wait_ms = p->pause_ms;
+		if (p->sparse_ms &&
+		    k_uptime_get_32() - status_led_since >= STATUS_LED_BACKOFF_SEC * 1000U) {
+			wait_ms = p->sparse_ms;
+		}
+	}
+
+	if (p->once && status_led_step == 0) {
+		atomic_clear_bit(&status_led_active, status_led_current);
+		status_led_select();
+	} else {
+		k_timer_start(&status_led_timer, K_MSEC(wait_ms), K_NO_WAIT);
+	}
+
+	prof_end(PROF_STATUS_LED, prof);
+}
+
+/**
+ * Raise or clear an indication. Safe to call from any thread.
+ */
+static void status_led_indicate(enum status_led_indication ind, bool active)
+{
+	unsigned int key;
+
+	if (!device_is_ready(status_led.port)) {
+		return;
+	}
+
+	if (active) {
+		atomic_set_bit(&status_led_active, ind);
+	} else {
+		atomic_clear_bit(&status_led_active, ind);
+	}
+
+	key = irq_lock();
+	status_led_select();
+	irq_unlock(key);
+}
+
+/**
+ * Show download progress as 1-4 flashes per code.
+ */
+static void status_led_ota_progress(uint8_t percent)
+{
+	status_led_ota_flashes = 1U + MIN(percent, 99U) / 25U;
+	status_led_indicate(STATUS_LED_OTA, true);
+}
+
+/**
+ * Restart the current code at the full rate (user interaction).
+ */
+static void status_led_wake(void)
+{
+	unsigned int key = irq_lock();
+
+	status_led_since = k_uptime_get_32();
+	if (status_led_current >= 0) {
+		status_led_step = 0;
+		gpio_pin_set_dt(&status_led, 0);
+		k_timer_start(&status_led_timer, K_NO_WAIT, K_NO_WAIT);
+	}
+
+	irq_unlock(key);
+}
+
+/**
+ * Drop every indication and leave the LED dark.
+ */
+static void status_led_stop(void)
+{
+	unsigned int key = irq_lock();
+
+	atomic_clear(&status_led_active);
+	status_led_select();
+	irq_unlock(key);
+}
+
+static void update_status_led(void)
+{
+	status_led_indicate(STATUS_LED_NOT_JOINED, !ZB_JOINED());
+}
+
+static void status_led_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(status_led.port)) {
+		return;
+	}
+
+	ret = gpio_pin_configure_dt(&status_led, GPIO_OUTPUT_INACTIVE);
+	if (ret < 0) {
+		LOG_WRN("Status LED config failed: %d", ret);
+		return;
+	}
+
+	k_timer_init(&status_led_timer, status_led_timer_handler, NULL);
+}
+
+/* ==========================================================================
+ * Battery State of Charge - Load model, learned resistance, coulomb counting
+ * ========================================================================== */
+
+#ifndef LIGHT_ROLE_ROUTER
+
+/*
+ * Load current is modelled from the PWM duty: while the bridge runs, one
+ * half of the string conducts at any time, so the draw is the full-load
+ * current scaled by duty. Readings are normally taken with the bridge
+ * stopped; one that had to be taken under load is corrected for the drop.
+ * The resistance is learned from a probe: once the LED load has been
+ * steady for SOC_R_SETTLE_MS, the next sample reads the battery under load
+ * and then with the bridge stopped, back to back. At most one probe runs
+ * per SOC_R_PROBE_INTERVAL_MS. The charge drawn between samples is
+ * integrated so the reported SoC only ever goes down on battery.
+ */
+
+#define SOC_BASE_LOAD_UA                50U     /* MCU + radio average */
+#define SOC_UNKNOWN                     0xFFFFU
+#define SOC_UAMS_PER_CENTI              ((uint64_t)BATTERY_CAPACITY_MAH * 360000U)
+
+/* Resistance learning from loaded/unloaded reading pairs */
+#define SOC_R_DEFAULT_MOHM              150U
+#define SOC_R_MIN_MOHM                  20U
+#define SOC_R_MAX_MOHM                  2000U
+#define SOC_R_STEP_MIN_UA               50000U  /* No probe under 50 mA of LED load */
+#define SOC_R_SETTLE_MS                 30000U  /* Load steady this long before probing */
+#define SOC_R_PROBE_INTERVAL_MS         (15U * 60U * 1000U)
+
+/* Weight of the voltage estimate against the integrator: 1 / 2^N */
+#define SOC_FUSE_SHIFT                  3U
+
+/* Re-sync to the voltage estimate on a jump this large (charged/swapped) */
+#define SOC_RESYNC_CENTI                1000U
+
+static struct k_spinlock soc_lock;
+static uint32_t soc_load_ua = SOC_BASE_LOAD_UA;
+static int64_t soc_load_since;       /* Uptime of the last integration step */
+static int64_t soc_load_changed_at;  /* Uptime of the last load change */
+static uint64_t soc_drawn_uams;      /* Charge drawn since the last sample (uA*ms) */
+static uint32_t soc_r_mohm = SOC_R_DEFAULT_MOHM;
+static uint16_t soc_centi = SOC_UNKNOWN;
+static volatile bool soc_r_probe;    /* Next sample takes a loaded reading too */
+static int64_t soc_r_probe_at;       /* Uptime of the last probe */
+
+/**
+ * Account for a PWM change. Called from light_set_brightness() with the
+ * CIE-corrected duty (0-255), so it has to stay cheap.
+ */
+static void soc_load_update(uint8_t duty)
+{
+	uint32_t load_ua = SOC_BASE_LOAD_UA + led_load_ua(duty);
+	k_spinlock_key_t key = k_spin_lock(&soc_lock);
+	int64_t now = k_uptime_get();
+
+	if (load_ua == soc_load_ua) {
+		k_spin_unlock(&soc_lock, key);
+		return;
+	}
+
+	soc_drawn_uams += (uint64_t)soc_load_ua * (uint64_t)(now - soc_load_since);
+	soc_load_since = now;
+	soc_load_ua = load_ua;
+	soc_load_changed_at = now;
+
+	k_spin_unlock(&soc_lock, key);
+
+	/* Probe the resistance once the LED load has settled, at most once per interval */
+	if (!soc_r_probe && load_ua - SOC_BASE_LOAD_UA >= SOC_R_STEP_MIN_UA &&
+	    (soc_r_probe_at == 0 || now - soc_r_probe_at >= SOC_R_PROBE_INTERVAL_MS) &&
+	    k_work_delayable_is_pending(&battery_work)) {
+		soc_r_probe = true;
+		io_work_reschedule(&battery_work, K_MSEC(SOC_R_SETTLE_MS));
+	}
+}
+
+#else /* LIGHT_ROLE_ROUTER */
+
+static void soc_load_update(uint8_t duty)
+{
+	ARG_UNUSED(duty);
+}
+
+#endif /* LIGHT_ROLE_ROUTER */
+
+/* ==========================================================================
+ * PWM Light Control
+ * ========================================================================== */
+
+/*
+ * CIE 1931 lightness correction lookup table.
+ * Maps linear input (0-255) to perceptually linear PWM output (0-255).
+ * Human vision perceives brightness logarithmically, so this table
+ * compensates to make dimming feel smooth and linear.
+ */
+static const uint8_t cie1931_lut[256] = {
+	  0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,
+	  2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,   3,   3,   3,   3,   4,
+	  4,   4,   4,   4,   4,   5,   5,   5,   5,   5,   6,   6,   6,   6,   6,   7,
+	  7,   7,   7,   8,   8,   8,   8,   9,   9,   9,  10,  10,  10,  10,  11,  11,
+	 11,  12,  12,  12,  13,  13,  13,  14,  14,  15,  15,  15,  16,  16,  17,  17,
+	 17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  23,  24,  24,  25,
+	 25,  26,  26,  27,  28,  28,  29,  29,  30,  31,  31,  32,  32,  33,  34,  34,
+	 35,  36,  37,  37,  38,  39,  39,  40,  41,  42,  43,  43,  44,  45,  46,  47,
+	 47,  48,  49,  50,  51,  52,  53,  54,  54,  55,  56,  57,  58,  59,  60,  61,
+	 62,  63,  64,  65,  66,  67,  68,  70,  71,  72,  73,  74,  75,  76,  77,  79,
+	 80,  81,  82,  83,  85,  86,  87,  88,  90,  91,  92,  94,  95,  96,  98,  99,
+	100, 102, 103, 105, 106, 108, 109, 110, 112, 113, 115, 116, 118, 120, 121, 123,
+	124, 126, 128, 129, 131, 132, 134, 136, 138, 139, 141, 143, 145, 146, 148, 150,
+	152, 154, 155, 157, 159, 161, 163, 165, 167, 169, 171, 173, 175, 177, 179, 181,
+	183, 185, 187, 189, 191, 193, 196, 198, 200, 202, 204, 207, 209, 211, 214, 216,
+	218, 220, 223, 225, 228, 230, 232, 235, 237, 240, 242, 245, 247, 250, 252, 255,
+};
+
+/* Track actual PWM brightness for transitions */
+static uint8_t current_brightness;
+
+static void light_set_brightness(zb_uint8_t brightness)
+{
+	/* Apply CIE 1931 perceptual correction, capped on low battery */
+	uint8_t corrected = cie1931_lut[MIN(brightness, guard_ceiling)];
+
+	/* Calculate pulse width */
+	uint32_t pulse = (uint64_t)corrected * pwm_brightness.period / 255U;
+
+	if (pwm_set_pulse_dt(&pwm_brightness, pulse)) {
+		LOG_ERR("PWM set failed");
+		return;
+	}
+
+	current_brightness = brightness;
+	latency_probe(LATENCY_STAGE_PWM);
+	soc_load_update(corrected);
+	energy_led_update(corrected);
+
+	/* Control TB6612 on/off based on brightness */
+	if (brightness > 0 && !light_is_on) {
+		tb6612_on();
+	} else if (brightness == 0 && light_is_on) {
+		tb6612_off();
+	}
+
+	LOG_DBG("Brightness: %u -> %u (pulse: %u)", brightness, corrected, pulse);
+}
+
+/* ==========================================================================
+ * Light Command Queue - ZBOSS thread to light engine
+ * ========================================================================== */
+
+/*
+ * The light output (PWM, fade and effect state) is owned by the light work
+ * queue. The ZBOSS thread, the only producer, never touches it: it pushes a
+ * command into a single-producer/single-consumer ring and submits the
+ * consumer, so a ZCL callback returns in constant time. Head is only written
+ * by the producer and tail only by the consumer. Attributes stay owned by
+ * the ZBOSS thread; other contexts that change the light go through
+ * zigbee_schedule_callback() first.
+ *
+ * Bursts (a slider drag sends a Move to Level every few tens of ms) are
+ * coalesced: the first command of a burst is applied at once, later ones
+ * collect for LIGHT_CMD_COALESCE_MS and only the last fade of the batch
+ * retargets the running transition.
+ */
+
+#define LIGHT_CMD_QUEUE_SIZE            16U     /* Power of two */
+#define LIGHT_CMD_COALESCE_MS           40U
+
+enum light_cmd_type {
+	LIGHT_CMD_FADE,                 /* Level over duration_ms, 0 = instant */
+	LIGHT_CMD_RAMP,                 /* Like FADE, at constant speed */
+	LIGHT_CMD_EFFECT,               /* Identify effect */
+	LIGHT_CMD_STOP,                 /* Stop a fade where it is, sync the level back */
+};
+
+struct light_cmd {
+	uint8_t type;
+	uint8_t value;
+	uint32_t duration_ms;           /* Scene transitions reach 6553.5 s */
+};
+
+BUILD_ASSERT(IS_POWER_OF_TWO(LIGHT_CMD_QUEUE_SIZE), "queue size must be a power of two");
+
+static struct light_cmd light_cmd_ring[LIGHT_CMD_QUEUE_SIZE];
+static atomic_t light_cmd_head;
+static atomic_t light_cmd_tail;
+static uint32_t light_cmd_last_ms;      /* Producer side, last push */
+static uint32_t light_cmd_dropped;
+static uint32_t light_cmd_coalesced;
+static struct k_work_delayable light_cmd_work;
+static struct k_work light_reapply_work;
+
+static void light_cmd_push(enum light_cmd_type type, uint8_t value, uint32_t duration_ms)
+{
+	atomic_val_t head = atomic_get(&light_cmd_head);
+
+	if (head - atomic_get(&light_cmd_tail) >= LIGHT_CMD_QUEUE_SIZE) {
+		light_cmd_dropped++;
+		LOG_WRN("Light command queue full (%u dropped)", light_cmd_dropped);
+		return;
+	}
+
+	light_cmd_ring[head & (LIGHT_CMD_QUEUE_SIZE - 1U)] = (struct light_cmd){
+		.type = type,
+		.value = value,
+		.duration_ms = duration_ms,
+	};
+
+	/* Publish the slot before the consumer can see the new head */
+	atomic_set(&light_cmd_head, head + 1);
+
+	/* No-op if the consumer is already scheduled: the command joins the batch */
+	uint32_t now = k_uptime_get_32();
+
+	light_work_schedule(&light_cmd_work, (now - light_cmd_last_ms < LIGHT_CMD_COALESCE_MS) ?
+			    K_MSEC(LIGHT_CMD_COALESCE_MS) : K_NO_WAIT);
+	light_cmd_last_ms = now;
+}
+
+/**
+ * Set the light level immediately, cancelling any fade. ZBOSS thread only.
+ */
+static void light_cmd_set(uint8_t level)
+{
+	light_cmd_push(LIGHT_CMD_FADE, level, 0);
+}
+
+/**
+ * Fade the light to @p level. ZBOSS thread only.
+ */
+static void light_cmd_fade(uint8_t level, uint32_t duration_ms)
+{
+	light_cmd_push(LIGHT_CMD_FADE, level, duration_ms);
+}
+
+/**
+ * Move the light to @p level at constant speed (hold-to-dim). ZBOSS thread only.
+ */
+static void light_cmd_ramp(uint8_t level, uint32_t duration_ms)
+{
+	light_cmd_push(LIGHT_CMD_RAMP, level, duration_ms);
+}
+
+/**
+ * Start (or stop) an identify effect. ZBOSS thread only.
+ */
+static void light_cmd_effect(uint8_t effect_id)
+{
+	light_cmd_push(LIGHT_CMD_EFFECT, effect_id, 0);
+}
+
+/**
+ * Stop a running fade at its current position. ZBOSS thread only.
+ */
+static void light_cmd_stop(void)
+{
+	light_cmd_push(LIGHT_CMD_STOP, 0, 0);
+}
+
+/**
+ * Copy the queue counters into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
+ */
+static void light_cmd_update_attrs(void)
+{
+	dev_ctx.diag_attr.cmd_coalesced = light_cmd_coalesced;
+	dev_ctx.diag_attr.cmd_dropped = light_cmd_dropped;
+}
+
+/* Re-apply the current level, e.g. under a new brightness ceiling */
+static void light_reapply_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	light_set_brightness(current_brightness);
+}
+
+/* ==========================================================================
+ * Smooth Brightness Transitions
+ * ========================================================================== */
+
+/*
+ * Fades follow a cubic Hermite curve from the current position and velocity
+ * to the target, arriving with zero velocity. Retargeting mid-fade starts a
+ * new curve from where the light is and how fast it is moving, so a run of
+ * commands looks like one motion rather than a series of kinks. The start
+ * velocity is capped when it points at the target (Fritsch-Carlson, |v|T <=
+ * 3 delta) so the curve never overshoots. A retarget keeps the running
+ * fade's average speed, so a small correction finishes early instead of
+ * taking the full transition time. A ramp (hold-to-dim) is a straight line
+ * instead, so the level moves at the requested rate from start to end.
+ *
+ * Position is in level units Q16, velocity in level units Q16 per ms.
+ */
+
+#define TRANSITION_STEP_MS 20 /* Update every 20ms for smooth 50Hz */
+
+#define FADE_Q                          16
+#define FADE_ONE                        (1 << FADE_Q)
+#define FADE_MIN_MS                     (2 * TRANSITION_STEP_MS)
+
+static struct k_work_delayable transition_work;
+static int32_t fade_p0;                 /* Start position */
+static int32_t fade_p1;                 /* Target position */
+static int32_t fade_v0;                 /* Start velocity */
+static int32_t fade_pos;                /* Current position */
+static int32_t fade_vel;                /* Current velocity */
+static uint32_t fade_elapsed;
+static uint32_t fade_duration;
+static bool fade_linear;                /* Constant speed ramp, no easing */
+
+/**
+ * Evaluate the curve at fade_elapsed into fade_pos/fade_vel.
+ */
+static void fade_eval(void)
+{
+	int64_t t = fade_duration;
+
+	if (fade_linear) {
+		fade_pos = fade_p0 + (int32_t)((int64_t)(fade_p1 - fade_p0) * fade_elapsed / t);
+		fade_vel = (int32_t)((fade_p1 - fade_p0) / t);
+		return;
+	}
+
+	int64_t s = ((int64_t)fade_elapsed << FADE_Q) / t;
+	int64_t s2 = (s * s) >> FADE_Q;
+	int64_t s3 = (s2 * s) >> FADE_Q;
+	/* Hermite basis (end velocity is zero, so h11 drops out) */
+	int64_t h00 = 2 * s3 - 3 * s2 + FADE_ONE;
+	int64_t h10 = s3 - 2 * s2 + s;
+	int64_t h01 = -2 * s3 + 3 * s2;
+	/* Derivatives with respect to s */
+	int64_t d00 = 6 * s2 - 6 * s;
+	int64_t d10 = 3 * s2 - 4 * s + FADE_ONE;
+	int64_t pos;
+
+	pos = ((h00 * fade_p0 + h01 * fade_p1) >> FADE_Q) + ((h10 * fade_v0 * t) >> FADE_Q);
+	fade_pos = CLAMP(pos, 0, 255 * FADE_ONE);
+	fade_vel = (int32_t)((((d00 * (fade_p0 - fade_p1)) >> FADE_Q) / t) +
+			     ((d10 * fade_v0) >> FADE_Q));
+}
+
+static void transition_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	fade_elapsed += TRANSITION_STEP_MS;
+
+	if (fade_elapsed >= fade_duration) {
+		/* Transition complete */
+		fade_pos = fade_p1;
+		fade_vel = 0;
+		light_set_brightness(fade_p1 >> FADE_Q);
+	} else {
+		fade_eval();
+		light_set_brightness((fade_pos + FADE_ONE / 2) >> FADE_Q);
+		light_work_schedule(&transition_work, K_MSEC(TRANSITION_STEP_MS));
+	}
+
+	prof_end(PROF_TRANSITION, prof);
+}
+
+/**
+ * Move to @p target over @p duration_ms, eased (Hermite) or, if @p linear,
+ * at constant speed.
+ */
+static void light_fade_to(uint8_t target, uint32_t duration_ms, bool linear)
+{
+	bool running = k_work_delayable_is_pending(&transition_work);
+	int32_t p1 = (int32_t)target << FADE_Q;
+	int32_t delta;
+
+	if (!running) {
+		/* At rest wherever the light was last set */
+		fade_pos = (int32_t)current_brightness << FADE_Q;
+		fade_vel = 0;
+	}
+
+	if (duration_ms == 0 || (!running && current_brightness == target)) {
+		/* Instant change or already at target */
+		k_work_cancel_delayable(&transition_work);
+		fade_pos = p1;
+		fade_vel = 0;
+		light_set_brightness(target);
+		return;
+	}
+
+	delta = p1 - fade_pos;
+
+	if (running && !linear && fade_p1 != fade_p0) {
+		/* Keep the running fade's average speed for the remaining distance */
+		uint32_t keep_ms = (uint32_t)((int64_t)abs(delta) * fade_duration /
+					      abs(fade_p1 - fade_p0));
+
+		duration_ms = CLAMP(keep_ms, FADE_MIN_MS, MAX(duration_ms, FADE_MIN_MS));
+	}
+
+	/* No overshoot: cap a start velocity that already heads for the target */
+	if (!linear && (int64_t)fade_vel * delta > 0 &&
+	    (int64_t)abs(fade_vel) * duration_ms > 3 * (int64_t)abs(delta)) {
+		fade_vel = 3 * delta / (int32_t)duration_ms;
+	}
+
+	fade_p0 = fade_pos;
+	fade_p1 = p1;
+	fade_v0 = fade_vel;
+	fade_elapsed = 0;
+	fade_duration = duration_ms;
+	fade_linear = linear;
+
+	LOG_INF("Fade: %u -> %u over %ums", (fade_p0 + FADE_ONE / 2) >> FADE_Q, target,
+		duration_ms);
+
+	/* A user is probably interacting, keep the radio responsive */
+	poll_activity();
+
+	/* A running transition continues on the new curve at its next step */
+	if (!running) {
+		light_work_schedule(&transition_work, K_NO_WAIT);
+	}
+}
+
+/**
+ * Mark the current scene as no longer matching the light state.
+ */
+static void scenes_invalidate(void)
+{
+	dev_ctx.scenes_attr.scene_valid = ZB_FALSE;
+}
+
+/*
+ * ZBOSS runs a Move to Level as a series of CurrentLevel writes, one per
+ * step. Applied one by one they would be instant jumps, each cancelling the
+ * previous fade. Instead the endpoint handler starts a single fade to the
+ * command's target over its transition time, and the step writes in between
+ * only keep the attribute (and its reports) moving. A newer command goes
+ * through the command queue again, so a burst coalesces and retargets the
+ * running fade. ZBOSS thread only.
+ */
+
+#define LEVEL_MOVE_SLACK_MS             500U    /* ZBOSS steps may finish a little late */
+
+static struct {
+	bool active;
+	uint8_t target;
+	int64_t until;
+} level_move;
+
+static void level_move_start(uint8_t level, uint32_t transition_ms)
+{
+	light_cmd_fade(level, transition_ms);
+
+	level_move.active = transition_ms > 0;
+	level_move.target = level;
+	level_move.until = k_uptime_get() + transition_ms + LEVEL_MOVE_SLACK_MS;
+}
+
+static bool level_move_active(void)
+{
+	if (level_move.active && k_uptime_get() > level_move.until) {
+		level_move.active = false;
+	}
+
+	return level_move.active;
+}
+
+static void level_move_stop(void)
+{
+	if (level_move_active()) {
+		light_cmd_stop();
+		level_move.active = false;
+	}
+}
+
+static void level_control_set_value(zb_uint16_t new_level)
+{
+	latency_probe(LATENCY_STAGE_LEVEL);
+
+	LOG_INF("Set level: %u", new_level);
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+		(zb_uint8_t *)&new_level,
+		ZB_FALSE);
+
+	if (!level_move_active()) {
+		light_cmd_set((zb_uint8_t)new_level);
+	} else if (new_level == level_move.target) {
+		/* Last step of a Move to Level, the fade lands there by itself */
+		level_move.active = false;
+	}
+
+	if (new_level > 0) {
+		app_state.last_brightness = (uint8_t)new_level;
+	}
+
+	scenes_invalidate();
+	save_light_state();
+}
+
+static void on_off_set_value(zb_bool_t on)
+{
+	LOG_INF("Set on/off: %s", on ? "ON" : "OFF");
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_ON_OFF,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+		(zb_uint8_t *)&on,
+		ZB_FALSE);
+
+	if (!on) {
+		level_move.active = false;
+		light_cmd_set(0U);
+	} else if (!level_move_active()) {
+		light_cmd_set(dev_ctx.level_control_attr.current_level);
+	}
+	/* else: switched on by a Move to Level with On/Off, its fade drives the light */
+
+	scenes_invalidate();
+	save_light_state();
+}
+
+/* ==========================================================================
+ * On/Off Timed Off - OnTime / OffWaitTime handled locally
+ * ========================================================================== */
+
+/*
+ * Instead of decrementing OnTime/OffWaitTime every 1/10 s as the ZCL spec
+ * describes, we keep absolute deadlines and only derive the attribute values
+ * when someone looks at them (attribute read or a new command). The only
+ * wakeup is the single delayable work item firing at the OnTime deadline.
+ * OffWaitTime expiry needs no action, so it never schedules anything.
+ */
+
+#define ON_OFF_TIME_INFINITE            0xFFFFU
+#define ON_OFF_TIME_UNIT_MS             100U
+
+/* On With Timed Off control field: bit 0 = accept only when on */
+#define ON_OFF_CTRL_ACCEPT_ONLY_WHEN_ON BIT(0)
+
+static struct k_work_delayable timed_off_work;
+static int64_t on_time_deadline;   /* Uptime (ms) when OnTime reaches 0, 0 = idle */
+static int64_t off_wait_deadline;  /* Uptime (ms) when OffWaitTime reaches 0, 0 = idle */
+
+static uint16_t timed_deadline_to_tenths(int64_t deadline)
+{
+	int64_t remaining = deadline - k_uptime_get();
+
+	if (remaining <= 0) {
+		return 0;
+	}
+
+	/* Round up so the attribute never reads 0 while still counting */
+	return (uint16_t)MIN((remaining + ON_OFF_TIME_UNIT_MS - 1) / ON_OFF_TIME_UNIT_MS,
+			     ON_OFF_TIME_INFINITE - 1);
+}
+
+/**
+ * Bring the OnTime/OffWaitTime attributes up to date from the deadlines.
+ */
+static void on_off_timed_refresh(void)
+{
+	if (on_time_deadline) {
+		dev_ctx.on_off_attr.on_time = timed_deadline_to_tenths(on_time_deadline);
+		if (dev_ctx.on_off_attr.on_time == 0) {
+			on_time_deadline = 0;
+		}
+	}
+
+	if (off_wait_deadline) {
+		dev_ctx.on_off_attr.off_wait_time = timed_deadline_to_tenths(off_wait_deadline);
+		if (dev_ctx.on_off_attr.off_wait_time == 0) {
+			off_wait_deadline = 0;
+		}
+	}
+}
+
+/**
+ * Recompute deadlines from the current attribute values.
+ * @param on  On/Off state the light is in (or about to be in)
+ */
+static void on_off_timed_arm(bool on)
+{
+	uint16_t on_time = dev_ctx.on_off_attr.on_time;
+	uint16_t off_wait = dev_ctx.on_off_attr.off_wait_time;
+	int64_t now = k_uptime_get();
+
+	on_time_deadline = 0;
+	off_wait_deadline = 0;
+
+	/* Per spec, nothing counts down while either attribute is 0xFFFF */
+	if (on_time == ON_OFF_TIME_INFINITE || off_wait == ON_OFF_TIME_INFINITE) {
+		k_work_cancel_delayable(&timed_off_work);
+		return;
+	}
+
+	if (on && on_time > 0) {
+		on_time_deadline = now + (int64_t)on_time * ON_OFF_TIME_UNIT_MS;
+		light_work_reschedule(&timed_off_work, K_MSEC((uint32_t)on_time * ON_OFF_TIME_UNIT_MS));
+	} else {
+		k_work_cancel_delayable(&timed_off_work);
+	}
+
+	if (!on && off_wait > 0) {
+		off_wait_deadline = now + (int64_t)off_wait * ON_OFF_TIME_UNIT_MS;
+	}
+}
+
+/**
+ * OnTime or OffWaitTime written directly. ZBOSS calls the device callback
+ * before it stores the value, so restart the countdown from the new one.
+ */
+static void on_off_timed_write(zb_uint16_t attr_id, uint16_t value)
+{
+	if (attr_id == ZB_ZCL_ATTR_ON_OFF_ON_TIME) {
+		dev_ctx.on_off_attr.on_time = value;
+	} else {
+		dev_ctx.on_off_attr.off_wait_time = value;
+	}
+
+	on_off_timed_arm(dev_ctx.on_off_attr.on_off);
+}
+
+/**
+ * Apply the OnTime/OffWaitTime side effects of a plain On/Off/Toggle.
+ * @param turning_on  true for On (or Toggle from off), false for Off
+ */
+static void on_off_timed_handle_cmd(bool turning_on)
+{
+	on_off_timed_refresh();
+
+	if (turning_on) {
+		if (dev_ctx.on_off_attr.on_time == 0) {
+			dev_ctx.on_off_attr.off_wait_time = 0;
+		}
+	} else {
+		dev_ctx.on_off_attr.on_time = 0;
+	}
+
+	on_off_timed_arm(turning_on);
+}
+
+/**
+ * On With Timed Off command (ZCL 3.8.2.3.6).
+ */
+static void on_off_with_timed_off(uint8_t control, uint16_t on_time, uint16_t off_wait)
+{
+	bool is_on = dev_ctx.on_off_attr.on_off;
+
+	on_off_timed_refresh();
+
+	if ((control & ON_OFF_CTRL_ACCEPT_ONLY_WHEN_ON) && !is_on) {
+		LOG_DBG("Timed off: ignored (accept only when on)");
+		latency_probe_cancel();
+		return;
+	}
+
+	if (!is_on && dev_ctx.on_off_attr.off_wait_time > 0) {
+		latency_probe_cancel();
+		/* Still in the off-wait guard period: only shorten it */
+		dev_ctx.on_off_attr.off_wait_time =
+			MIN(dev_ctx.on_off_attr.off_wait_time, off_wait);
+		on_off_timed_arm(false);
+		LOG_INF("Timed off: guard, off wait %u", dev_ctx.on_off_attr.off_wait_time);
+		return;
+	}
+
+	dev_ctx.on_off_attr.on_time = MAX(dev_ctx.on_off_attr.on_time, on_time);
+	dev_ctx.on_off_attr.off_wait_time = off_wait;
+
+	if (!is_on) {
+		on_off_set_value(ZB_TRUE);
+	} else {
+		/* Already on, only the timers change */
+		latency_probe_cancel();
+	}
+
+	on_off_timed_arm(true);
+
+	LOG_INF("Timed off: on for %u, off wait %u (1/10 s)",
+		dev_ctx.on_off_attr.on_time, dev_ctx.on_off_attr.off_wait_time);
+}
+
+static void timed_off_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	on_time_deadline = 0;
+	dev_ctx.on_off_attr.on_time = 0;
+
+	LOG_INF("Timed off: on time elapsed");
+
+	/* OffWaitTime keeps counting as a guard against re-triggering */
+	on_off_set_value(ZB_FALSE);
+	on_off_timed_arm(false);
+}
+
+static void timed_off_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	/* Attributes and the light queue are driven from the ZBOSS thread */
+	zigbee_schedule_callback(timed_off_cb, 0);
+}
+
+/**
+ * Toggle with the OnOffTransitionTime fade. ZBOSS thread only, other
+ * contexts schedule it with zigbee_schedule_callback().
+ */
+static void light_toggle(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	zb_bool_t new_state = !dev_ctx.on_off_attr.on_off;
+	uint8_t target_level;
+
+	if (new_state) {
+		/* Turning on - use last brightness or default */
+		target_level = (dev_ctx.level_control_attr.current_level > 0) ?
+			dev_ctx.level_control_attr.current_level :
+			app_state.last_brightness;
+		if (target_level == 0) {
+			target_level = 255; /* Default to full if no previous */
+		}
+	} else {
+		/* Turning off */
+		target_level = 0;
+	}
+
+	/* A local toggle follows the same OnTime/OffWaitTime rules as Toggle */
+	on_off_timed_handle_cmd(new_state);
+
+	/* Update Zigbee attributes, reported together in one frame per cluster */
+	report_set(REPORT_ON_OFF, &new_state);
+	if (new_state) {
+		report_set(REPORT_LEVEL, &target_level);
+	}
+
+	/* Smooth fade using configured transition time (convert 1/10s to ms) */
+	uint32_t transition_ms = dev_ctx.level_control_attr.on_off_transition_time * 100U;
+	if (transition_ms == 0) {
+		transition_ms = 1000; /* Default 1s if not set */
+	}
+	light_cmd_fade(target_level, transition_ms);
+
+	if (target_level > 0) {
+		app_state.last_brightness = target_level;
+	}
+
+	scenes_invalidate();
+
+	/* Persist state for power-on restore */
+	save_light_state();
+
+	LOG_INF("Toggle: %s (level %u, fade %ums)",
+		new_state ? "ON" : "OFF", target_level, transition_ms);
+}
+
+/* ==========================================================================
+ * Identify Effects
+ * ========================================================================== */
+
+static void effect_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	switch (effect_type) {
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_BLINK:
+		/* Single blink: on then off */
+		if (effect_step == 0) {
+			light_set_brightness(255);
+			effect_step = 1;
+			light_work_schedule(&effect_work, K_MSEC(500));
+		} else {
+			/* Restore previous state */
+			if (dev_ctx.on_off_attr.on_off) {
+				light_set_brightness(dev_ctx.level_control_attr.current_level);
+			} else {
+				light_set_brightness(0);
+			}
+			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		}
+		break;
+
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_BREATHE:
+		/* Breathe: fade up and down, 15 times over ~15 seconds */
+		if (effect_step < 30) {
+			uint8_t brightness;
+			if (effect_step % 2 == 0) {
+				brightness = 255;
+			} else {
+				brightness = 0;
+			}
+			light_set_brightness(brightness);
+			effect_step++;
+			light_work_schedule(&effect_work, K_MSEC(500));
+		} else {
+			/* Restore previous state */
+			if (dev_ctx.on_off_attr.on_off) {
+				light_set_brightness(dev_ctx.level_control_attr.current_level);
+			} else {
+				light_set_brightness(0);
+			}
+			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		}
+		break;
+
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_OKAY:
+		/* Okay: two quick flashes */
+		if (effect_step < 4) {
+			uint8_t brightness = (effect_step % 2 == 0) ? 255 : 0;
+			light_set_brightness(brightness);
+			effect_step++;
+			light_work_schedule(&effect_work, K_MSEC(200));
+		} else {
+			/* Restore previous state */
+			if (dev_ctx.on_off_attr.on_off) {
+				light_set_brightness(dev_ctx.level_control_attr.current_level);
+			} else {
+				light_set_brightness(0);
+			}
+			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		}
+		break;
+
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_CHANNEL_CHANGE:
+		/* Channel change: bright then dim for 8 seconds */
+		if (effect_step == 0) {
+			light_set_brightness(255);
+			effect_step = 1;
+			light_work_schedule(&effect_work, K_MSEC(500));
+		} else if (effect_step == 1) {
+			light_set_brightness(25);
+			effect_step = 2;
+			light_work_schedule(&effect_work, K_MSEC(7500));
+		} else {
+			/* Restore previous state */
+			if (dev_ctx.on_off_attr.on_off) {
+				light_set_brightness(dev_ctx.level_control_attr.current_level);
+			} else {
+				light_set_brightness(0);
+			}
+			effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		}
+		break;
+
+	case LIGHT_EFFECT_IDENTIFY:
+		/* Identify: pulse between full and dim until stopped */
+		light_set_brightness((effect_step++ % 2 == 0) ? 255 : 25);
+		light_work_schedule(&effect_work, K_MSEC(700));
+		break;
+
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT:
+	case ZB_ZCL_IDENTIFY_EFFECT_ID_STOP:
+	default:
+		/* Restore previous state */
+		if (dev_ctx.on_off_attr.on_off) {
+			light_set_brightness(dev_ctx.level_control_attr.current_level);
+		} else {
+			light_set_brightness(0);
+		}
+		effect_type = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+		break;
+	}
+
+	prof_end(PROF_EFFECT, prof);
+}
+
+static void start_identify_effect(uint8_t effect_id)
+{
+	LOG_INF("Identify effect: %u", effect_id);
+
+	/* Cancel any running effect */
+	k_work_cancel_delayable(&effect_work);
+
+	effect_type = effect_id;
+	effect_step = 0;
+
+	if (effect_id == ZB_ZCL_IDENTIFY_EFFECT_ID_STOP ||
+	    effect_id == ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT) {
+		/* Immediately restore state */
+		if (dev_ctx.on_off_attr.on_off) {
+			light_set_brightness(dev_ctx.level_control_attr.current_level);
+		} else {
+			light_set_brightness(0);
+		}
+	} else {
+		/* Start effect */
+		light_work_schedule(&effect_work, K_NO_WAIT);
+	}
+}
+
+/* ==========================================================================
+ * Light Engine - Applies queued commands on the light work queue
+ * ========================================================================== */
+
+/**
+ * Adopt the level the engine stopped at (ZBOSS thread).
+ */
+static void light_level_sync_cb(zb_uint8_t level)
+{
+	if (level == 0) {
+		return;
+	}
+
+	report_set(REPORT_LEVEL, &level);
+	app_state.last_brightness = level;
+	scenes_invalidate();
+	save_light_state();
+}
+
+static void light_cmd_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	atomic_val_t tail = atomic_get(&light_cmd_tail);
+	struct light_cmd fade;
+	bool fade_pending = false;
+
+	while (tail != atomic_get(&light_cmd_head)) {
+		struct light_cmd cmd = light_cmd_ring[tail & (LIGHT_CMD_QUEUE_SIZE - 1U)];
+
+		atomic_set(&light_cmd_tail, ++tail);
+
+		if (cmd.type == LIGHT_CMD_FADE || cmd.type == LIGHT_CMD_RAMP) {
+			/* Only the latest fade of a run matters */
+			if (fade_pending) {
+				light_cmd_coalesced++;
+			}
+			fade = cmd;
+			fade_pending = true;
+			continue;
+		}
+
+		/* Keep the order around anything that is not a fade */
+		if (fade_pending) {
+			light_fade_to(fade.value, fade.duration_ms, fade.type == LIGHT_CMD_RAMP);
+			fade_pending = false;
+		}
+
+		if (cmd.type == LIGHT_CMD_EFFECT) {
+			start_identify_effect(cmd.value);
+		} else if (cmd.type == LIGHT_CMD_STOP) {
+			k_work_cancel_delayable(&transition_work);
+			fade_vel = 0;
+			zigbee_schedule_callback(light_level_sync_cb, current_brightness);
+		}
+	}
+
+	if (fade_pending) {
+		light_fade_to(fade.value, fade.duration_ms, fade.type == LIGHT_CMD_RAMP);
+	}
+}
+
+/* ==========================================================================
+ * Scenes - Scene table with per-slot NVS persistence
+ * ========================================================================== */
+
+/*
+ * The scene table is an open-addressed hash keyed on (group, scene), so a
+ * recall is a single indexed lookup in the common case. Each slot is
+ * persisted under its own settings key ("scenes/<slot>") so storing one
+ * scene only rewrites 8 bytes of NVS.
+ */
+
+#ifdef CONFIG_APP_SCENE_TABLE_SIZE
+#define SCENE_TABLE_SIZE                CONFIG_APP_SCENE_TABLE_SIZE
+#else
+#define SCENE_TABLE_SIZE                16U
+#endif
+
+BUILD_ASSERT((SCENE_TABLE_SIZE & (SCENE_TABLE_SIZE - 1)) == 0,
+	     "Scene table size must be a power of two");
+
+#define SCENE_FLAG_USED                 BIT(0)
+#define SCENE_FLAG_DELETED              BIT(1)  /* Tombstone, keeps probe chains intact */
+#define SCENE_FLAG_HAS_ON_OFF           BIT(2)
+#define SCENE_FLAG_HAS_LEVEL            BIT(3)
+#define SCENE_FLAG_ON                   BIT(4)
+
+#define SCENE_RECALL_TRANSITION_UNSET   0xFFFFU
+
+struct light_scene {
+	uint16_t group_id;
+	uint8_t  scene_id;
+	uint8_t  flags;
+	uint8_t  level;
+	uint8_t  effect;           /* Identify effect running when stored, 0xFF = none */
+	uint16_t transition_time;  /* 1/10 s */
+} __packed;
+
+static struct light_scene scene_table[SCENE_TABLE_SIZE];
+
+static uint32_t scene_hash(uint16_t group_id, uint8_t scene_id)
+{
+	uint32_t key = ((uint32_t)group_id << 8) | scene_id;
+
+	/* Knuth multiplicative hash, top bits are best mixed */
+	return (key * 2654435761U) >> 16;
+}
+
+/**
+ * Find a scene slot.
+ * @param create  If true, return a free slot for the key when not found
+ * @return Slot index or -1
+ */
+static int scene_find(uint16_t group_id, uint8_t scene_id, bool create)
+{
+	uint32_t idx = scene_hash(group_id, scene_id);
+	int free_slot = -1;
+
+	for (uint32_t i = 0; i < SCENE_TABLE_SIZE; i++) {
+		uint32_t slot = (idx + i) & (SCENE_TABLE_SIZE - 1);
+		struct light_scene *s = &scene_table[slot];
+
+		if (s->flags & SCENE_FLAG_USED) {
+			if (s->group_id == group_id && s->scene_id == scene_id) {
+				return slot;
+			}
+		} else {
+			if (free_slot < 0) {
+				free_slot = slot;
+			}
+			if (!(s->flags & SCENE_FLAG_DELETED)) {
+				/* Never-used slot ends the probe chain */
+				break;
+			}
+		}
+	}
+
+	return create ? free_slot : -1;
+}
+
+static ATOMIC_DEFINE(scene_dirty, SCENE_TABLE_SIZE);
+static struct k_work scene_save_work;
+
+static void scene_save_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	char key[16];
+
+	for (int slot = 0; slot < SCENE_TABLE_SIZE; slot++) {
+		if (!atomic_test_and_clear_bit(scene_dirty, slot)) {
+			continue;
+		}
+
+		snprintk(key, sizeof(key), "scenes/%d", slot);
+
+		/* Tombstones are persisted too, or probe chains break after a reboot */
+		if (scene_table[slot].flags & (SCENE_FLAG_USED | SCENE_FLAG_DELETED)) {
+			settings_save_one(key, &scene_table[slot], sizeof(scene_table[slot]));
+		} else {
+			settings_delete(key);
+		}
+	}
+}
+
+/**
+ * Persist a slot from the I/O queue.
+ */
+static void scene_save_slot(int slot)
+{
+	atomic_set_bit(scene_dirty, slot);
+	io_work_submit(&scene_save_work);
+}
+
+static void scene_update_count(void)
+{
+	uint8_t count = 0;
+
+	for (size_t i = 0; i < SCENE_TABLE_SIZE; i++) {
+		if (scene_table[i].flags & SCENE_FLAG_USED) {
+			count++;
+		}
+	}
+
+	dev_ctx.scenes_attr.scene_count = count;
+}
+
+static void scene_remove_slot(int slot)
+{
+	if (dev_ctx.scenes_attr.current_group == scene_table[slot].group_id &&
+	    dev_ctx.scenes_attr.current_scene == scene_table[slot].scene_id) {
+		dev_ctx.scenes_attr.scene_valid = ZB_FALSE;
+	}
+
+	memset(&scene_table[slot], 0, sizeof(scene_table[slot]));
+	scene_table[slot].flags = SCENE_FLAG_DELETED;
+	scene_save_slot(slot);
+}
+
+/**
+ * Remove every scene belonging to a group (Remove All Scenes, Remove Group).
+ */
+static void scene_remove_group(uint16_t group_id)
+{
+	for (int slot = 0; slot < SCENE_TABLE_SIZE; slot++) {
+		if ((scene_table[slot].flags & SCENE_FLAG_USED) &&
+		    scene_table[slot].group_id == group_id) {
+			scene_remove_slot(slot);
+		}
+	}
+
+	scene_update_count();
+}
+
+static int scenes_settings_set(const char *name, size_t len,
+			       settings_read_cb read_cb, void *cb_arg)
+{
+	unsigned long slot = strtoul(name, NULL, 10);
+
+	if (slot >= SCENE_TABLE_SIZE || len != sizeof(struct light_scene)) {
+		return -EINVAL;
+	}
+
+	read_cb(cb_arg, &scene_table[slot], len);
+	return 0;
+}
+
+static int scenes_settings_commit(void)
+{
+	scene_update_count();
+	LOG_INF("Restored %u scenes", dev_ctx.scenes_attr.scene_count);
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(scenes, "scenes", NULL, scenes_settings_set,
+			       scenes_settings_commit, NULL);
+
+static zb_uint8_t scene_store(uint16_t group_id, uint8_t scene_id)
+{
+	int slot = scene_find(group_id, scene_id, true);
+
+	if (slot < 0) {
+		return ZB_ZCL_STATUS_INSUFF_SPACE;
+	}
+
+	struct light_scene *s = &scene_table[slot];
+	uint16_t transition = (s->flags & SCENE_FLAG_USED) ? s->transition_time : 0;
+
+	s->group_id = group_id;
+	s->scene_id = scene_id;
+	s->flags = SCENE_FLAG_USED | SCENE_FLAG_HAS_ON_OFF | SCENE_FLAG_HAS_LEVEL;
+	if (dev_ctx.on_off_attr.on_off) {
+		s->flags |= SCENE_FLAG_ON;
+	}
+	s->level = dev_ctx.level_control_attr.current_level;
+	s->effect = (k_work_delayable_is_pending(&effect_work) &&
+		     effect_type != LIGHT_EFFECT_IDENTIFY) ?
+		effect_type : ZB_ZCL_IDENTIFY_EFFECT_ID_STOP;
+	s->transition_time = transition;
+
+	scene_save_slot(slot);
+	scene_update_count();
+
+	dev_ctx.scenes_attr.current_group = group_id;
+	dev_ctx.scenes_attr.current_scene = scene_id;
+	dev_ctx.scenes_attr.scene_valid = ZB_TRUE;
+
+	LOG_INF("Scene stored: group 0x%04x scene %u (slot %d)", group_id, scene_id, slot);
+	return ZB_ZCL_STATUS_SUCCESS;
+}
+
+static zb_uint8_t scene_recall(uint16_t group_id, uint8_t scene_id, uint16_t transition_time)
+{
+	int slot = scene_find(group_id, scene_id, false);
+
+	if (slot < 0) {
+		return ZB_ZCL_STATUS_NOT_FOUND;
+	}
+
+	const struct light_scene *s = &scene_table[slot];
+	zb_bool_t on = dev_ctx.on_off_attr.on_off;
+	uint8_t level = dev_ctx.level_control_attr.current_level;
+
+	if (transition_time == SCENE_RECALL_TRANSITION_UNSET) {
+		transition_time = s->transition_time;
+	}
+
+	if (s->flags & SCENE_FLAG_HAS_ON_OFF) {
+		on = (s->flags & SCENE_FLAG_ON) ? ZB_TRUE : ZB_FALSE;
+		on_off_timed_handle_cmd(on);
+		report_set(REPORT_ON_OFF, &on);
+	}
+
+	if ((s->flags & SCENE_FLAG_HAS_LEVEL) && s->level > 0) {
+		level = s->level;
+		report_set(REPORT_LEVEL, &level);
+		app_state.last_brightness = level;
+	}
+
+	/* Drive the fade engine directly from the stored state */
+	light_cmd_fade(on ? level : 0U, (uint32_t)transition_time * 100U);
+
+	if (s->effect != ZB_ZCL_IDENTIFY_EFFECT_ID_STOP) {
+		light_cmd_effect(s->effect);
+	}
+
+	save_light_state();
+
+	dev_ctx.scenes_attr.current_group = group_id;
+	dev_ctx.scenes_attr.current_scene = scene_id;
+	dev_ctx.scenes_attr.scene_valid = ZB_TRUE;
+
+	LOG_INF("Scene recalled: group 0x%04x scene %u (%s, level %u, %u/10 s)",
+		group_id, scene_id, on ? "ON" : "OFF", level, transition_time);
+	return ZB_ZCL_STATUS_SUCCESS;
+}
+
+/* ==========================================================================
+ * Battery Measurement - LiPo via VDDH (nRF52840)
+ * ========================================================================== */
+
+#ifndef LIGHT_ROLE_ROUTER
+
+/*
+ * LiPo voltage to percentage lookup table.
+ * Based on typical LiPo discharge curve with values in millivolts.
+ * Converts VDDH voltage (from ADC) to battery percentage.
+ *
+ * LiPo characteristics:
+ * - Full charge: 4.20V (100%)
+ * - Nominal: 3.70V (~50%)
+ * - Cutoff: 3.00V (0%) - below this risks damage
+ *
+ * The discharge curve is non-linear:
+ * - Steep drop from 4.2V to ~4.0V
+ * - Relatively flat from 4.0V to 3.6V
+ * - Gradual drop from 3.6V to 3.3V
+ * - Steep drop below 3.3V
+ */
+struct battery_level_point {
+	uint16_t mv;      /* Voltage in millivolts */
+	uint8_t  percent; /* Percentage (0-100) */
+};
+
+static const struct battery_level_point lipo_discharge_curve[] = {
+	{ 4200, 100 },
+	{ 4150,  95 },
+	{ 4110,  90 },
+	{ 4080,  85 },
+	{ 4020,  80 },
+	{ 3980,  75 },
+	{ 3950,  70 },
+	{ 3910,  65 },
+	{ 3870,  60 },
+	{ 3840,  55 },
+	{ 3800,  50 },
+	{ 3760,  45 },
+	{ 3730,  40 },
+	{ 3690,  35 },
+	{ 3660,  30 },
+	{ 3620,  25 },
+	{ 3580,  20 },
+	{ 3500,  15 },
+	{ 3450,  10 },
+	{ 3300,   5 },
+	{ 3000,   0 },
+};
+
+#define BATTERY_CURVE_SIZE ARRAY_SIZE(lipo_discharge_curve)
+
+/**
+ * Convert battery voltage (mV) to percentage using lookup table with interpolation.
+ */
+static uint8_t battery_mv_to_percent(uint16_t mv)
+{
+	if (mv >= lipo_discharge_curve[0].mv) {
+		return 100;
+	}
+
+	if (mv <= lipo_discharge_curve[BATTERY_CURVE_SIZE - 1].mv) {
+		return 0;
+	}
+
+	/* Find the two points to interpolate between */
+	for (size_t i = 0; i < BATTERY_CURVE_SIZE - 1; i++) {
+		if (mv >= lipo_discharge_curve[i + 1].mv) {
+			/* Linear interpolation */
+			uint16_t v_high = lipo_discharge_curve[i].mv;
+			uint16_t v_low = lipo_discharge_curve[i + 1].mv;
+			uint8_t p_high = lipo_discharge_curve[i].percent;
+			uint8_t p_low = lipo_discharge_curve[i + 1].percent;
+
+			uint16_t v_range = v_high - v_low;
+			uint8_t p_range = p_high - p_low;
+
+			return p_low + ((mv - v_low) * p_range) / v_range;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Stop the bridge at the next polarity swap so the battery can be sampled
+ * without the LED load (no IR sag). Blocks up to one polarity period.
+ * Returns true when the load is off; release with battery_load_resume().
+ * The polarity timer restarts the bridge by itself after
+ * POLARITY_STOP_MAX_TICKS, so the string is never dark for longer.
+ */
+static bool battery_load_pause(void)
+{
+	polarity_stop_expired = false;
+
+	if (!light_is_on) {
+		return true;
+	}
+
+	k_sem_reset(&polarity_stop_sem);
+	polarity_stop_req = true;
+
+	if (k_sem_take(&polarity_stop_sem, K_USEC(polarity_period_us)) == 0) {
+		return true;
+	}
+
+	/* Light turned off meanwhile, or the timer missed the window */
+	polarity_stop_req = false;
+	return !light_is_on;
+}
+
+static void battery_load_resume(void)
+{
+	/* The next polarity tick drives the bridge again */
+	polarity_stopped = false;
+}
+
+/**
+ * Measure VDDH voltage using nRF52840 SAADC.
+ * Returns voltage in millivolts, or 0 on failure. @p unloaded is set when
+ * no LED current flowed during the conversion.
+ *
+ * The channel is configured once in battery_init(). Each reading is 16
+ * hardware-averaged conversions (burst mode). With @p pause, it is taken
+ * with the bridge stopped unless the polarity timer missed the stop window.
+ */
+static uint16_t battery_measure_mv(bool pause, bool *unloaded)
+{
+	int16_t sample;
+	uint16_t voltage_mv;
+
+	if (!adc_dev) {
+		LOG_ERR("ADC not initialized");
+		return 0;
+	}
+
+	struct adc_sequence sequence = {
+		.channels = BIT(BATTERY_ADC_CHANNEL),
+		.buffer = &sample,
+		.buffer_size = sizeof(sample),
+		.resolution = 12,
+		.oversampling = BATTERY_ADC_OVERSAMPLING,
+	};
+
+	int ret;
+
+	if (pause) {
+		/* Not preemptible between stop and restart. While blocked on the
+		 * conversion other threads may run, so the polarity timer bounds
+		 * the dark time if that overruns.
+		 */
+		k_sched_lock();
+		*unloaded = battery_load_pause();
+		ret = adc_read(adc_dev, &sequence);
+		battery_load_resume();
+		k_sched_unlock();
+
+		if (polarity_stop_expired) {
+			/* The bridge ran again before the conversion finished */
+			*unloaded = false;
+		}
+	} else {
+		*unloaded = !light_is_on;
+		ret = adc_read(adc_dev, &sequence);
+	}
+
+	if (ret < 0) {
+		LOG_ERR("ADC read failed: %d", ret);
+		return 0;
+	}
+
+	if (sample < 0) {
+		/* Single-ended input can read slightly negative near zero */
+		sample = 0;
+	}
+
+	/* Convert to millivolts
+	 * VDDHDIV5 input, 0.6V reference, gain 1/6:
+	 * VDDH = sample * 0.6 * 6 * 5 / 4096
+	 * VDDH_mV = sample * 18000 / 4096 = sample * 4.395
+	 */
+	voltage_mv = (uint32_t)sample * 18000U / 4096U;
+
+	LOG_DBG("Battery ADC: %d -> %u mV%s", sample, voltage_mv, *unloaded ? "" : " (loaded)");
+
+	return voltage_mv;
+}
+
+/**
+ * Feed a reading into the moving average and return the filtered value.
+ */
+static uint16_t battery_filter_mv(uint16_t mv)
+{
+	uint32_t sample_q4 = (uint32_t)mv << 4;
+
+	if (battery_ema_mv_q4 == 0) {
+		/* Seed with the first reading */
+		battery_ema_mv_q4 = sample_q4;
+	} else {
+		battery_ema_mv_q4 = battery_ema_mv_q4 + ((int32_t)(sample_q4 - battery_ema_mv_q4) >>
+							 BATTERY_EMA_SHIFT);
+	}
+
+	return battery_ema_mv_q4 >> 4;
+}
+
+/**
+ * Claim a pending resistance probe. Due once the LED load has been steady
+ * for SOC_R_SETTLE_MS; a load change since then voids it.
+ */
+static bool soc_r_probe_take(void)
+{
+	int64_t now = k_uptime_get();
+	bool due = soc_r_probe && light_is_on && now - soc_load_changed_at >= SOC_R_SETTLE_MS;
+
+	soc_r_probe = false;
+	if (due) {
+		soc_r_probe_at = now;
+	}
+
+	return due;
+}
+
+/**
+ * Learn the effective resistance from a loaded and an unloaded reading taken
+ * back to back. @p load_ua is the current flowing during the loaded one.
+ */
+static void soc_learn_resistance(uint16_t unloaded_mv, uint16_t loaded_mv, uint32_t load_ua)
+{
+	if (load_ua < SOC_R_STEP_MIN_UA) {
+		return;
+	}
+
+	/* mV / uA = kOhm, scaled to mOhm */
+	int32_t r_mohm = ((int32_t)unloaded_mv - (int32_t)loaded_mv) * 1000000 / (int32_t)load_ua;
+
+	if (r_mohm < (int32_t)SOC_R_MIN_MOHM || r_mohm > (int32_t)SOC_R_MAX_MOHM) {
+		LOG_DBG("SoC: rejected R estimate %d mOhm", r_mohm);
+		return;
+	}
+
+	soc_r_mohm = soc_r_mohm + ((int32_t)(r_mohm - soc_r_mohm) >> 2);
+	LOG_INF("SoC: battery resistance %u mOhm (at %u mA)", soc_r_mohm, load_ua / 1000U);
+}
+
+/**
+ * Combine a filtered voltage sample with the integrated charge (see the
+ * State of Charge section). @p unloaded: the reading was taken with the
+ * bridge stopped, so it carries no IR drop to correct for.
+ * Returns SoC in 0.01 % units.
+ */
+static uint16_t soc_update(uint16_t mv, bool unloaded)
+{
+	k_spinlock_key_t key = k_spin_lock(&soc_lock);
+	int64_t now = k_uptime_get();
+	uint32_t load_ua = soc_load_ua;
+
+	soc_drawn_uams += (uint64_t)load_ua * (uint64_t)(now - soc_load_since);
+	soc_load_since = now;
+
+	uint64_t drawn = soc_drawn_uams;
+
+	soc_drawn_uams = 0;
+	k_spin_unlock(&soc_lock, key);
+
+	/* Current through the battery while the ADC sampled */
+	uint32_t sample_ua = unloaded ? 0 : load_ua;
+
+	/* Open-circuit estimate: add back the drop caused by the modelled load */
+	uint16_t ocv_mv = mv + (uint16_t)((uint64_t)sample_ua * soc_r_mohm / 1000000U);
+	int32_t v_soc = battery_mv_to_percent(ocv_mv) * 100;
+
+	if (soc_centi == SOC_UNKNOWN || v_soc > soc_centi + (int32_t)SOC_RESYNC_CENTI) {
+		soc_centi = v_soc;
+	} else {
+		int32_t cc_soc = soc_centi - (int32_t)(drawn / SOC_UAMS_PER_CENTI);
+		int32_t fused = cc_soc + ((v_soc - cc_soc) >> SOC_FUSE_SHIFT);
+
+		/* Never report a rise on battery */
+		soc_centi = CLAMP(fused, 0, soc_centi);
+	}
+
+	LOG_DBG("SoC: %u mV (OCV %u mV) -> %d.%02d%%, drawn %u uAh", mv, ocv_mv,
+		soc_centi / 100, soc_centi % 100, (uint32_t)(drawn / 3600000U));
+
+	return soc_centi;
+}
+
+/* Low battery guardian ---------------------------------------------------- */
+
+/*
+ * As the (unloaded, filtered) voltage approaches BatteryVoltageMinThreshold
+ * the brightness ceiling drops linearly from full to GUARD_CEILING_MIN over
+ * the last GUARD_RAMP_MV. Below GUARD_LOW_MV and GUARD_CRITICAL_MV the
+ * polarity frequency and poll rate are halved / quartered. At the threshold
+ * the bridge is put in standby and the chip enters System OFF; the button
+ * wakes it (reset). Nothing is limited while USB powered.
+ */
+
+#ifdef CONFIG_APP_BATTERY_GUARD
+
+#define GUARD_RAMP_MV                   500U    /* Ceiling ramp above the cutoff */
+#define GUARD_CEILING_MIN               40U
+#define GUARD_LOW_MV                    3500U
+#define GUARD_CRITICAL_MV               3300U
+#define GUARD_HYSTERESIS_MV             50U
+#define GUARD_POWEROFF_DELAY_MS         5000U   /* Time to report the alarm */
+
+/* BatteryAlarmState bits */
+#define GUARD_ALARM_MIN_THRESHOLD       BIT(0)
+#define GUARD_ALARM_THRESHOLD_1         BIT(1)
+#define GUARD_ALARM_THRESHOLD_2         BIT(2)
+
+enum guard_level {
+	GUARD_NORMAL,
+	GUARD_LOW,
+	GUARD_CRITICAL,
+	GUARD_CUTOFF,
+};
+
+static struct k_work_delayable guard_poweroff_work;
+static enum guard_level guard_level;
+
+static void guard_poweroff_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (vbus_present) {
+		/* Plugged in while waiting */
+		return;
+	}
+
+	LOG_WRN("Battery cutoff: entering System OFF, press button to wake");
+
+	save_light_state_flush();
+
+	/* Bridge to standby, LEDs dark */
+	pwm_set_pulse_dt(&pwm_brightness, 0);
+	tb6612_off();
+	status_led_stop();
+
+	/* Level interrupt sets GPIO SENSE, which wakes the chip from System OFF */
+	gpio_pin_interrupt_configure_dt(&button, GPIO_INT_LEVEL_ACTIVE);
+
+	sys_poweroff();
+}
+
+static enum guard_level guard_classify(uint16_t mv, uint16_t cutoff_mv)
+{
+	/* Recovering needs GUARD_HYSTERESIS_MV above the entry point */
+	uint16_t margin = 0;
+
+	if (mv <= cutoff_mv) {
+		return GUARD_CUTOFF;
+	}
+
+	if (guard_level >= GUARD_CRITICAL) {
+		margin = GUARD_HYSTERESIS_MV;
+	}
+	if (mv < GUARD_CRITICAL_MV + margin) {
+		return GUARD_CRITICAL;
+	}
+
+	margin = (guard_level >= GUARD_LOW) ? GUARD_HYSTERESIS_MV : 0;
+	if (mv < GUARD_LOW_MV + margin) {
+		return GUARD_LOW;
+	}
+
+	return GUARD_NORMAL;
+}
+
+/**
+ * Re-evaluate the protection state for a new voltage sample.
+ * Returns the BatteryAlarmState bitmap.
+ */
+static zb_uint32_t guard_update(uint16_t mv)
+{
+	uint16_t cutoff_mv = dev_ctx.power_config_attr.battery_voltage_min_threshold * 100U;
+	enum guard_level level = vbus_present ? GUARD_NORMAL : guard_classify(mv, cutoff_mv);
+	uint8_t ceiling = 255;
+
+	if (!vbus_present && mv < cutoff_mv + GUARD_RAMP_MV) {
+		uint32_t above = (mv > cutoff_mv) ? mv - cutoff_mv : 0;
+
+		ceiling = GUARD_CEILING_MIN + (255U - GUARD_CEILING_MIN) * above / GUARD_RAMP_MV;
+	}
+
+	if (ceiling != guard_ceiling) {
+		guard_ceiling = ceiling;
+		/* Re-apply the current level under the new ceiling */
+		light_work_submit(&light_reapply_work);
+		LOG_INF("Battery guard: brightness ceiling %u", ceiling);
+	}
+
+	if (level != guard_level) {
+		static const uint8_t shift[] = {
+			[GUARD_NORMAL] = 0, [GUARD_LOW] = 1, [GUARD_CRITICAL] = 2, [GUARD_CUTOFF] = 2,
+		};
+
+		LOG_WRN("Battery guard: level %d -> %d (%u mV)", guard_level, level, mv);
+		guard_level = level;
+
+		tb6612_set_period(POLARITY_PERIOD_US << shift[level]);
+		poll_set_idle_shift(shift[level]);
+		status_led_indicate(STATUS_LED_LOW_BATTERY, level >= GUARD_LOW);
+
+		if (level == GUARD_CUTOFF) {
+			k_work_reschedule(&guard_poweroff_work, K_MSEC(GUARD_POWEROFF_DELAY_MS));
+		} else {
+			k_work_cancel_delayable(&guard_poweroff_work);
+		}
+	}
+
+	switch (level) {
+	case GUARD_CUTOFF:
+		return GUARD_ALARM_MIN_THRESHOLD | GUARD_ALARM_THRESHOLD_2 | GUARD_ALARM_THRESHOLD_1;
+	case GUARD_CRITICAL:
+		return GUARD_ALARM_THRESHOLD_2 | GUARD_ALARM_THRESHOLD_1;
+	case GUARD_LOW:
+		return GUARD_ALARM_THRESHOLD_1;
+	default:
+		return 0;
+	}
+}
+
+#else
+
+static zb_uint32_t guard_update(uint16_t mv)
+{
+	ARG_UNUSED(mv);
+	return 0;
+}
+
+#endif /* CONFIG_APP_BATTERY_GUARD */
+
+/* Attribute values handed to the ZBOSS thread */
+static zb_uint8_t battery_staged_voltage;
+static zb_uint8_t battery_staged_percentage;
+static zb_uint32_t battery_staged_alarm_state;
+
+/**
+ * Apply the staged values. Runs in the ZBOSS thread; whatever exceeds the
+ * configured delta goes out in a single Power Configuration report.
+ */
+static void battery_attr_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	report_set(REPORT_BATTERY_VOLTAGE, &battery_staged_voltage);
+	report_set(REPORT_BATTERY_PERCENTAGE, &battery_staged_percentage);
+	report_set(REPORT_BATTERY_ALARM_STATE, &battery_staged_alarm_state);
+}
+
+/**
+ * Sample the battery locally. The attributes (and so the radio) are only
+ * touched when the reported resolution (100mV / 0.5%) actually changes.
+ */
+static void battery_sample(void)
+{
+	bool unloaded;
+	uint16_t loaded_mv = 0;
+	uint32_t load_ua = soc_load_ua;
+
+	if (soc_r_probe_take()) {
+		/* Resistance probe: read under LED load first, then as usual */
+		loaded_mv = battery_measure_mv(false, &unloaded);
+		if (unloaded) {
+			loaded_mv = 0;
+		}
+	}
+
+	uint16_t raw_mv = battery_measure_mv(true, &unloaded);
+
+	if (raw_mv == 0) {
+		LOG_WRN("Battery measurement failed");
+		return;
+	}
+
+	if (loaded_mv != 0 && unloaded) {
+		soc_learn_resistance(raw_mv, loaded_mv, load_ua - SOC_BASE_LOAD_UA);
+	}
+
+	uint16_t voltage_mv = battery_filter_mv(raw_mv);
+	uint16_t soc = soc_update(voltage_mv, unloaded);
+
+	/* battery_voltage is in units of 100mV (ZCL spec)
+	 * battery_percentage is 0-200 (0.5% per unit, so 200 = 100%)
+	 */
+	zb_uint8_t voltage = voltage_mv / 100U;
+	zb_uint8_t percentage = soc / 50U;
+	zb_uint32_t alarm_state = guard_update(voltage_mv);
+
+	energy_set_supply_mv(vbus_present ? 5000U : voltage_mv);
+
+	LOG_DBG("Battery: %u mV (raw %u mV, %u%%)", voltage_mv, raw_mv, soc / 100U);
+
+	if (voltage == battery_staged_voltage && percentage == battery_staged_percentage &&
+	    alarm_state == battery_staged_alarm_state) {
+		return;
+	}
+
+	battery_staged_voltage = voltage;
+	battery_staged_percentage = percentage;
+	battery_staged_alarm_state = alarm_state;
+	zigbee_schedule_callback(battery_attr_cb, 0);
+
+	LOG_INF("Battery: %u mV (%u%%)", voltage_mv, soc / 100U);
+}
+
+/**
+ * Battery sample work handler - called periodically.
+ */
+static void battery_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	battery_sample();
+
+	/* Reschedule for next sample */
+	io_work_schedule(&battery_work, K_SECONDS(BATTERY_SAMPLE_INTERVAL_SEC));
+
+	prof_end(PROF_BATTERY, prof);
+}
+
+/**
+ * Install default reporting for voltage and percentage. A configuration
+ * written by the coordinator (Configure Reporting) is kept. Runs in the
+ * ZBOSS thread.
+ */
+static void battery_configure_reporting(void)
+{
+	static const struct {
+		zb_uint16_t attr_id;
+		zb_uint8_t  delta;
+	} attrs[] = {
+		{ ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_ID, BATTERY_REPORT_VOLTAGE_DELTA },
+		{ ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID, BATTERY_REPORT_PERCENT_DELTA },
+		/* Bitmap, reported on any change (the guard relies on it before System OFF) */
+		{ ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_ALARM_STATE_ID, 0 },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(attrs); i++) {
+		zb_zcl_reporting_info_t rep_info;
+
+		memset(&rep_info, 0, sizeof(rep_info));
+		rep_info.direction = ZB_ZCL_CONFIGURE_REPORTING_SEND_REPORT;
+		rep_info.ep = BATTERY_ENDPOINT;
+		rep_info.cluster_id = ZB_ZCL_CLUSTER_ID_POWER_CONFIG;
+		rep_info.cluster_role = ZB_ZCL_CLUSTER_SERVER_ROLE;
+		rep_info.attr_id = attrs[i].attr_id;
+		rep_info.dst.profile_id = ZB_AF_HA_PROFILE_ID;
+		rep_info.u.send_info.min_interval = BATTERY_REPORT_MIN_INTERVAL_SEC;
+		rep_info.u.send_info.max_interval = BATTERY_REPORT_INTERVAL_SEC;
+		rep_info.u.send_info.def_min_interval = BATTERY_REPORT_MIN_INTERVAL_SEC;
+		rep_info.u.send_info.def_max_interval = BATTERY_REPORT_INTERVAL_SEC;
+		rep_info.u.send_info.delta.u8 = attrs[i].delta;
+
+		zb_ret_t ret = zb_zcl_put_reporting_info(&rep_info, ZB_FALSE);
+
+		if (ret != RET_OK) {
+			LOG_WRN("Battery reporting config failed for attr 0x%04x: %d",
+				attrs[i].attr_id, ret);
+		}
+	}
+}
+
+/**
+ * Initialize battery measurement.
+ */
+static int battery_init(void)
+{
+	adc_dev = DEVICE_DT_GET(DT_NODELABEL(adc));
+	if (!device_is_ready(adc_dev)) {
+		LOG_ERR("ADC device not ready");
+		return -ENODEV;
+	}
+
+	/* Configure SAADC once for VDDH measurement
+	 * Input: VDDH/5 (internal divider, battery side of the REG0 stage)
+	 * Reference: Internal 0.6V, Gain: 1/6 -> 3.6V full scale = 18V VDDH
+	 * Acquisition: 40us, the divider has a high source impedance
+	 */
+	struct adc_channel_cfg channel_cfg = {
+		.gain = ADC_GAIN_1_6,
+		.reference = ADC_REF_INTERNAL,
+		.acquisition_time = ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 40),
+		.channel_id = BATTERY_ADC_CHANNEL,
+		.input_positive = SAADC_CH_PSELP_PSELP_VDDHDIV5,
+	};
+
+	int ret = adc_channel_setup(adc_dev, &channel_cfg);
+	if (ret < 0) {
+		LOG_ERR("ADC channel setup failed: %d", ret);
+		adc_dev = NULL;
+		return ret;
+	}
+
+	/* Initialize power config attributes */
+	dev_ctx.power_config_attr.battery_voltage = 0;
+	dev_ctx.power_config_attr.battery_percentage = 0;
+	dev_ctx.power_config_attr.battery_size = ZB_ZCL_POWER_CONFIG_BATTERY_SIZE_OTHER; /* LiPo */
+	dev_ctx.power_config_attr.battery_quantity = 1;
+	dev_ctx.power_config_attr.battery_rated_voltage = 37; /* 3.7V nominal in 100mV units */
+	dev_ctx.power_config_attr.battery_alarm_mask = 0;
+	dev_ctx.power_config_attr.battery_voltage_min_threshold = 30; /* 3.0V in 100mV units */
+	dev_ctx.power_config_attr.battery_alarm_state = 0;
+
+	/* Initialize work items */
+	k_work_init_delayable(&battery_work, battery_work_handler);
+#ifdef CONFIG_APP_BATTERY_GUARD
+	k_work_init_delayable(&guard_poweroff_work, guard_poweroff_work_handler);
+#endif
+
+	LOG_INF("Battery measurement initialized");
+
+	return 0;
+}
+
+/**
+ * Start periodic battery sampling.
+ * Called after network join and when USB power goes away.
+ */
+static void battery_start_reporting(void)
+{
+	if (vbus_present) {
+		LOG_INF("Battery reporting suspended (USB power)");
+		return;
+	}
+
+	/* Sample right away on the workqueue, then periodically */
+	io_work_reschedule(&battery_work, K_NO_WAIT);
+
+	LOG_INF("Battery sampling every %u s, report on change (max interval %u s)",
+		BATTERY_SAMPLE_INTERVAL_SEC, BATTERY_REPORT_INTERVAL_SEC);
+}
+
+/* ==========================================================================
+ * Power Source Detection - USB VBUS vs battery
+ * ========================================================================== */
+
+/*
+ * VBUS present: short polling, battery reporting suspended, Basic
+ * PowerSource = DC. VBUS absent: long-poll SED on battery. Detection uses
+ * the POWER peripheral USB events, which also fire when no USB stack runs.
+ */
+
+#ifdef CONFIG_APP_POWER_SOURCE_DETECT
+
+static struct k_work power_source_work;
+
+/**
+ * Update the Basic cluster PowerSource attribute. Runs in the ZBOSS thread.
+ */
+static void power_source_attr_cb(zb_uint8_t vbus)
+{
+	zb_uint8_t power_source = vbus ? ZB_ZCL_BASIC_POWER_SOURCE_DC_SOURCE :
+					 ZB_ZCL_BASIC_POWER_SOURCE_BATTERY;
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_BASIC,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID,
+		&power_source,
+		ZB_FALSE);
+}
+
+static void power_source_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	bool vbus = nrfx_power_usbstatus_get() != NRFX_POWER_USB_STATE_DISCONNECTED;
+
+	if (vbus == vbus_present) {
+		return;
+	}
+
+	vbus_present = vbus;
+	LOG_INF("Power source: %s", vbus ? "USB" : "battery");
+
+	poll_set_mains(vbus);
+
+	if (vbus) {
+		k_work_cancel_delayable(&battery_work);
+	} else {
+		/* The battery charged meanwhile: re-sync SoC to the next reading */
+		soc_centi = SOC_UNKNOWN;
+		if (ZB_JOINED()) {
+			battery_start_reporting();
+		}
+	}
+
+	zigbee_schedule_callback(power_source_attr_cb, vbus);
+}
+
+/* POWER interrupt context */
+static void power_usb_event_handler(nrfx_power_usb_evt_t event)
+{
+	if (event == NRFX_POWER_USB_EVT_DETECTED || event == NRFX_POWER_USB_EVT_REMOVED) {
+		k_work_submit(&power_source_work);
+	}
+}
+
+/**
+ * Detect the power source at boot and enable VBUS change events.
+ * Must run after clusters_attr_init().
+ */
+static void power_source_init(void)
+{
+	static const nrfx_power_usbevt_config_t usbevt_config = {
+		.handler = power_usb_event_handler,
+	};
+
+	k_work_init(&power_source_work, power_source_work_handler);
+
+	vbus_present = nrfx_power_usbstatus_get() != NRFX_POWER_USB_STATE_DISCONNECTED;
+	dev_ctx.basic_attr.power_source = vbus_present ? ZB_ZCL_BASIC_POWER_SOURCE_DC_SOURCE :
+							 ZB_ZCL_BASIC_POWER_SOURCE_BATTERY;
+	poll_set_mains(vbus_present);
+
+	nrfx_power_usbevt_init(&usbevt_config);
+	nrfx_power_usbevt_enable();
+
+	LOG_INF("Power source: %s", vbus_present ? "USB" : "battery");
+}
+
+#endif /* CONFIG_APP_POWER_SOURCE_DETECT */
+
+#endif /* !LIGHT_ROLE_ROUTER */
+
+/* ==========================================================================
+ * Bound Light Control - Button gestures mirrored to the switch endpoint
+ * ========================================================================== */
+
+/*
+ * Commands are sent from SWITCH_ENDPOINT without a destination, so the APS
+ * layer fans them out to every device and group bound to its On/Off and
+ * Level Control clients. With no bindings the frame is dropped locally
+ * and never reaches the radio. Explicit On/Off (not Toggle) keeps a bound
+ * set in step with this light even if one of them was switched apart.
+ */
+
+enum bind_cmd {
+	BIND_CMD_OFF,
+	BIND_CMD_ON,
+	BIND_CMD_LEVEL,                 /* arg: level, OnOffTransitionTime fade */
+	BIND_CMD_MOVE_UP,
+	BIND_CMD_MOVE_DOWN,
+	BIND_CMD_STOP,
+};
+
+static void bind_send(zb_bufid_t bufid, zb_uint16_t param)
+{
+	uint8_t cmd = param >> 8;
+	uint8_t arg = param & 0xFFU;
+	zb_uint16_t dst = 0;    /* Unused: bindings supply the destinations */
+
+	switch (cmd) {
+	case BIND_CMD_OFF:
+	case BIND_CMD_ON:
+		ZB_ZCL_ON_OFF_SEND_REQ(bufid, dst, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+				       0, SWITCH_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+				       ZB_ZCL_DISABLE_DEFAULT_RESPONSE,
+				       cmd == BIND_CMD_ON ? ZB_ZCL_CMD_ON_OFF_ON_ID :
+							    ZB_ZCL_CMD_ON_OFF_OFF_ID,
+				       NULL);
+		break;
+	case BIND_CMD_LEVEL:
+		ZB_ZCL_LEVEL_CONTROL_SEND_MOVE_TO_LEVEL_WITH_ON_OFF_REQ(
+			bufid, dst, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+			0, SWITCH_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+			ZB_ZCL_DISABLE_DEFAULT_RESPONSE, NULL,
+			arg, dev_ctx.level_control_attr.on_off_transition_time);
+		break;
+	case BIND_CMD_MOVE_UP:
+	case BIND_CMD_MOVE_DOWN:
+		ZB_ZCL_LEVEL_CONTROL_SEND_MOVE_WITH_ON_OFF_REQ(
+			bufid, dst, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+			0, SWITCH_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+			ZB_ZCL_DISABLE_DEFAULT_RESPONSE, NULL,
+			cmd == BIND_CMD_MOVE_UP ? ZB_ZCL_LEVEL_CONTROL_MOVE_MODE_UP :
+						  ZB_ZCL_LEVEL_CONTROL_MOVE_MODE_DOWN,
+			BUTTON_RAMP_RATE);
+		break;
+	case BIND_CMD_STOP:
+		ZB_ZCL_LEVEL_CONTROL_SEND_STOP_WITH_ON_OFF_REQ(
+			bufid, dst, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+			0, SWITCH_ENDPOINT, ZB_AF_HA_PROFILE_ID,
+			ZB_ZCL_DISABLE_DEFAULT_RESPONSE, NULL);
+		break;
+	default:
+		zb_buf_free(bufid);
+		return;
+	}
+
+	LOG_DBG("Bound command %u (%u) sent", cmd, arg);
+}
+
+/**
+ * Send @p cmd to the switch endpoint's bindings. ZBOSS thread.
+ */
+static void bind_command(enum bind_cmd cmd, uint8_t arg)
+{
+	if (!ZB_JOINED()) {
+		return;
+	}
+
+	if (zb_buf_get_out_delayed_ext(bind_send, ((zb_uint16_t)cmd << 8) | arg, 0) != RET_OK) {
+		LOG_WRN("Bound command %u: no buffer", cmd);
+	}
+}
+
+/* ==========================================================================
+ * Finding & Binding - Direct pairing with remotes
+ * ========================================================================== */
+
+/*
+ * A quadruple click opens the BDB Finding & Binding target window on the
+ * light endpoint: IdentifyTime runs for the commissioning time, so a remote
+ * in F&B initiator mode finds this light through Identify Query, reads its
+ * clusters and binds to it (or adds it to its group) directly. The remote
+ * then addresses the light itself and the coordinator is not involved.
+ * The light pulses while identifying and flashes "okay" when the window
+ * closes, either on timeout or when the remote stops the identify. A sleepy
+ * device polls fast for the window so it hears the query.
+ */
+
+/**
+ * Identify start/stop from the ZCL Identify server. ZBOSS thread.
+ */
+static void identify_notify_cb(zb_uint8_t param)
+{
+	if (param) {
+		LOG_INF("Identify started (%u s)", dev_ctx.identify_attr.identify_time);
+		poll_fast_for(dev_ctx.identify_attr.identify_time * 1000U);
+		light_cmd_effect(LIGHT_EFFECT_IDENTIFY);
+	} else {
+		LOG_INF("Identify stopped");
+		light_cmd_effect(ZB_ZCL_IDENTIFY_EFFECT_ID_STOP);
+	}
+}
+
+/**
+ * Open the F&B target window. ZBOSS thread.
+ */
+static void fb_target_start(void)
+{
+	zb_ret_t ret;
+
+	if (!ZB_JOINED()) {
+		LOG_INF("F&B: not joined");
+		return;
+	}
+
+	ret = zb_bdb_finding_binding_target(LIGHT_ENDPOINT);
+	if (ret != RET_OK) {
+		LOG_WRN("F&B target start failed: %d", ret);
+		return;
+	}
+
+	LOG_INF("F&B target: waiting for a remote");
+}
+
+/**
+ * F&B target window closed. The bindings live on the remote, so the target
+ * side cannot tell whether one was made; the flash just marks the end.
+ */
+static void fb_target_finished(zb_ret_t status)
+{
+	if (status == RET_OK) {
+		LOG_INF("F&B target finished");
+		light_cmd_effect(ZB_ZCL_IDENTIFY_EFFECT_ID_OKAY);
+	} else {
+		LOG_INF("F&B target ended: %d", status);
+	}
+}
+
+/* ==========================================================================
+ * Button Handling - Gesture recogniser
+ * ========================================================================== */
+
+/*
+ * Releases within BUTTON_CLICK_GAP_MS of each other form a click sequence,
+ * dispatched when the gap expires (single to quadruple). Holding from
+ * rest past BUTTON_HOLD_MS ramps the level at BUTTON_RAMP_RATE through the
+ * fade engine, alternating direction per hold, and stops where it is on
+ * release. A BUTTON_RESET_HOLD_MS hold leaves the network. Gestures run
+ * locally: actions go straight to the ZBOSS thread and the light engine,
+ * and toggle, level and ramp are mirrored to lights bound to the switch
+ * endpoint.
+ *
+ * Edges wake the CPU through the GPIO PORT (SENSE) event. The first edge
+ * masks the pin and schedules one re-sample BUTTON_DEBOUNCE_TIME_MS later,
+ * so contact bounce costs a single interrupt and the idle button costs
+ * nothing.
+ */
+
+enum gesture {
+	GESTURE_SINGLE,
+	GESTURE_DOUBLE,
+	GESTURE_TRIPLE,
+	GESTURE_QUADRUPLE,
+	GESTURES,
+};
+
+enum gesture_action_type {
+	GESTURE_ACTION_NONE,
+	GESTURE_ACTION_TOGGLE,
+	GESTURE_ACTION_LEVEL,           /* arg: level, turns the light on */
+	GESTURE_ACTION_SCENE,           /* arg: scene ID in the global scene group */
+	GESTURE_ACTION_EFFECT,          /* arg: identify effect ID */
+	GESTURE_ACTION_BIND,            /* open the F&B target window */
+};
+
+struct gesture_action {
+	uint8_t type;
+	uint8_t arg;
+};
+
+static const struct gesture_action gesture_actions[GESTURES] = {
+	[GESTURE_SINGLE] = { GESTURE_ACTION_TOGGLE, 0 },
+	[GESTURE_DOUBLE] = { GESTURE_ACTION_LEVEL, ZB_ZCL_LEVEL_CONTROL_LEVEL_MAX_VALUE },
+	[GESTURE_TRIPLE] = { GESTURE_ACTION_SCENE, 1 },
+	[GESTURE_QUADRUPLE] = { GESTURE_ACTION_BIND, 0 },
+};
+
+static struct k_work_delayable gesture_hold_work;
+static struct k_work_delayable gesture_click_work;
+static uint8_t gesture_clicks;
+static bool gesture_ramping;
+static bool gesture_ramp_up;            /* ZBOSS thread */
+
+/**
+ * Turn on at @p level with the OnOffTransitionTime fade. ZBOSS thread.
+ */
+static void gesture_set_level(uint8_t level)
+{
+	zb_bool_t on = ZB_TRUE;
+	uint32_t transition_ms = dev_ctx.level_control_attr.on_off_transition_time * 100U;
+
+	on_off_timed_handle_cmd(on);
+	report_set(REPORT_ON_OFF, &on);
+	report_set(REPORT_LEVEL, &level);
+	light_cmd_fade(level, transition_ms);
+
+	app_state.last_brightness = level;
+	scenes_invalidate();
+	save_light_state();
+}
+
+static void gesture_action_cb(zb_uint8_t gesture)
+{
+	const struct gesture_action *action = &gesture_actions[gesture];
+
+	LOG_INF("Gesture: %u click(s), action %u", gesture + 1U, action->type);
+
+	switch (action->type) {
+	case GESTURE_ACTION_TOGGLE:
+		light_toggle(0);
+		bind_command(dev_ctx.on_off_attr.on_off ? BIND_CMD_ON : BIND_CMD_OFF, 0);
+		break;
+	case GESTURE_ACTION_LEVEL:
+		gesture_set_level(action->arg);
+		bind_command(BIND_CMD_LEVEL, action->arg);
+		break;
+	case GESTURE_ACTION_SCENE:
+		if (scene_recall(0, action->arg, SCENE_RECALL_TRANSITION_UNSET) != ZB_ZCL_STATUS_SUCCESS) {
+			LOG_INF("Gesture: scene %u not stored", action->arg);
+		}
+		break;
+	case GESTURE_ACTION_EFFECT:
+		light_cmd_effect(action->arg);
+		break;
+	case GESTURE_ACTION_BIND:
+		fb_target_start();
+		break;
+	default:
+		break;
+	}
+}
+
+static void gesture_ramp_start_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	zb_bool_t on = ZB_TRUE;
+	uint8_t level = dev_ctx.level_control_attr.current_level;
+	uint8_t target;
+
+	if (!dev_ctx.on_off_attr.on_off) {
+		/* Off: brighten from dark */
+		level = 0;
+		gesture_ramp_up = true;
+		on_off_timed_handle_cmd(on);
+		report_set(REPORT_ON_OFF, &on);
+	} else if (level >= ZB_ZCL_LEVEL_CONTROL_LEVEL_MAX_VALUE) {
+		gesture_ramp_up = false;
+	} else if (level <= ZB_ZCL_LEVEL_CONTROL_LEVEL_MIN_VALUE + 1U) {
+		gesture_ramp_up = true;
+	} else {
+		gesture_ramp_up = !gesture_ramp_up;
+	}
+
+	target = gesture_ramp_up ? ZB_ZCL_LEVEL_CONTROL_LEVEL_MAX_VALUE :
+				   ZB_ZCL_LEVEL_CONTROL_LEVEL_MIN_VALUE + 1U;
+
+	LOG_INF("Ramp %s from %u", gesture_ramp_up ? "up" : "down", level);
+	light_cmd_ramp(target, MAX(1U, abs((int)target - (int)level) * 1000U / BUTTON_RAMP_RATE));
+	bind_command(gesture_ramp_up ? BIND_CMD_MOVE_UP : BIND_CMD_MOVE_DOWN, 0);
+}
+
+static void gesture_ramp_stop_cb(zb_uint8_t param)
+{
+	ARG_UNUSED(param);
+
+	/* The engine reports the level it stopped at back to this thread */
+	light_cmd_stop();
+	bind_command(BIND_CMD_STOP, 0);
+}
+
+static void gesture_click_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint8_t clicks = MIN(gesture_clicks, GESTURES);
+
+	gesture_clicks = 0;
+	if (clicks > 0) {
+		zigbee_schedule_callback(gesture_action_cb, clicks - 1U);
+	}
+}
+
+static void gesture_hold_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (!app_state.pressed) {
+		return;
+	}
+
+	/* Hold from rest ramps; a hold ending a click sequence cancels it */
+	if (gesture_clicks == 0) {
+		gesture_ramping = true;
+		zigbee_schedule_callback(gesture_ramp_start_cb, 0);
+	}
+	gesture_clicks = 0;
+}
+
+/**
+ * Debounced re-sample, BUTTON_DEBOUNCE_TIME_MS after the first edge.
+ *
+ * The edge interrupt is re-armed before sampling, so an edge that lands
+ * after the sample starts a new debounce window rather than being lost.
+ * A press shorter than the window samples as unchanged and is dropped.
+ */
+static void button_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
+
+	bool pressed = (gpio_pin_get_dt(&button) == 1);
+
+	if (pressed && !app_state.pressed) {
+		/* Button pressed */
+		app_state.pressed = true;
+		app_state.press_time = k_uptime_get();
+		poll_activity();
+		status_led_wake();
+		k_work_cancel_delayable(&gesture_click_work);
+		k_work_schedule(&gesture_hold_work, K_MSEC(BUTTON_HOLD_MS));
+		k_work_schedule(&long_press_work, K_MSEC(BUTTON_RESET_HOLD_MS));
+		LOG_DBG("Button pressed");
+	} else if (!pressed && app_state.pressed) {
+		/* Button released */
+		app_state.pressed = false;
+		k_work_cancel_delayable(&gesture_hold_work);
+		k_work_cancel_delayable(&long_press_work);
+
+		int64_t duration = k_uptime_get() - app_state.press_time;
+
+		if (gesture_ramping) {
+			gesture_ramping = false;
+			zigbee_schedule_callback(gesture_ramp_stop_cb, 0);
+		} else if (duration < BUTTON_HOLD_MS) {
+			gesture_clicks++;
+			k_work_schedule(&gesture_click_work, K_MSEC(BUTTON_CLICK_GAP_MS));
+		}
+		LOG_DBG("Button released after %lld ms", duration);
+	}
+
+	prof_end(PROF_BUTTON, prof);
+}
+
+static void long_press_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t prof = prof_begin();
+
+	if (app_state.pressed) {
+		LOG_INF("Reset hold - factory reset");
+
+		/* Leave network and restart steering */
+		if (ZB_JOINED()) {
+			zb_bdb_reset_via_local_action(0);
+		}
+		group_cache_clear();
+
+		status_led_indicate(STATUS_LED_RESET, true);
+	}
+
+	prof_end(PROF_BUTTON, prof);
+}
+
+static void button_gpio_handler(const struct device *dev,
+				struct gpio_callback *cb,
+				uint32_t pins)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(cb);
+	ARG_UNUSED(pins);
+
+	/* Mask the pin for the rest of the bounce: one interrupt per edge */
+	gpio_pin_interrupt_configure_dt(&button, GPIO_INT_DISABLE);
+	k_work_schedule(&button_work, K_MSEC(BUTTON_DEBOUNCE_TIME_MS));
+}
+
+static int button_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(button.port)) {
+		LOG_ERR("Button device not ready");
+		return -ENODEV;
+	}
+
+	ret = gpio_pin_configure_dt(&button, GPIO_INPUT);
+	if (ret < 0) {
+		LOG_ERR("Button config failed: %d", ret);
+		return ret;
+	}
+
+	ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
+	if (ret < 0) {
+		LOG_ERR("Button interrupt config failed: %d", ret);
+		return ret;
+	}
+
+	gpio_init_callback(&button_cb_data, button_gpio_handler, BIT(button.pin));
+	ret = gpio_add_callback(button.port, &button_cb_data);
+	if (ret < 0) {
+		LOG_ERR("Button callback add failed: %d", ret);
+		return ret;
+	}
+
+	k_work_init_delayable(&button_work, button_work_handler);
+	k_work_init_delayable(&long_press_work, long_press_work_handler);
+	k_work_init_delayable(&gesture_hold_work, gesture_hold_work_handler);
+	k_work_init_delayable(&gesture_click_work, gesture_click_work_handler);
+
+	LOG_INF("Button initialized on P0.%u", button.pin);
+	return 0;
+}
+
+/* ==========================================================================
+ * Zigbee Attribute Initialization
+ * ========================================================================== */
+
+static void clusters_attr_init(void)
+{
+	dev_ctx.basic_attr.zcl_version = ZB_ZCL_VERSION;
+	dev_ctx.basic_attr.app_version = BULB_INIT_BASIC_APP_VERSION;
+	dev_ctx.basic_attr.stack_version = BULB_INIT_BASIC_STACK_VERSION;
+	dev_ctx.basic_attr.hw_version = BULB_INIT_BASIC_HW_VERSION;
+#ifdef LIGHT_ROLE_ROUTER
+	dev_ctx.basic_attr.power_source = ZB_ZCL_BASIC_POWER_SOURCE_MAINS_SINGLE_PHASE;
+#else
+	dev_ctx.basic_attr.power_source = ZB_ZCL_BASIC_POWER_SOURCE_BATTERY;
+#endif
+	dev_ctx.basic_attr.ph_env = BULB_INIT_BASIC_PH_ENV;
+
+	ZB_ZCL_SET_STRING_VAL(
+		dev_ctx.basic_attr.mf_name,
+		BULB_INIT_BASIC_MANUF_NAME,
+		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_MANUF_NAME));
+
+	ZB_ZCL_SET_STRING_VAL(
+		dev_ctx.basic_attr.model_id,
+		BULB_INIT_BASIC_MODEL_ID,
+		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_MODEL_ID));
+
+	ZB_ZCL_SET_STRING_VAL(
+		dev_ctx.basic_attr.date_code,
+		BULB_INIT_BASIC_DATE_CODE,
+		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_DATE_CODE));
+
+	ZB_ZCL_SET_STRING_VAL(
+		dev_ctx.basic_attr.location_id,
+		BULB_INIT_BASIC_LOCATION_DESC,
+		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_LOCATION_DESC));
+
+	dev_ctx.identify_attr.identify_time = ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE;
+
+	/* Scenes attributes (scene_count is recomputed once the table is loaded) */
+	dev_ctx.scenes_attr.scene_count = 0;
+	dev_ctx.scenes_attr.current_scene = 0;
+	dev_ctx.scenes_attr.current_group = 0;
+	dev_ctx.scenes_attr.scene_valid = ZB_FALSE;
+	dev_ctx.scenes_attr.name_support = 0; /* Scene names not supported */
+
+	/* On/Off attributes */
+	dev_ctx.on_off_attr.on_off = ZB_ZCL_ON_OFF_IS_OFF;
+	dev_ctx.on_off_attr.global_scene_ctrl = ZB_TRUE;
+	dev_ctx.on_off_attr.on_time = 0;
+	dev_ctx.on_off_attr.off_wait_time = 0;
+	dev_ctx.on_off_attr.start_up_on_off = ZB_ZCL_ON_OFF_STARTUP_PREVIOUS;
+
+#ifdef LIGHT_ROLE_SLEEPY
+	/* Poll Control attributes - fast/idle bounds of the adaptive poll controller */
+	dev_ctx.poll_control_attr.checkin_interval = POLL_CHECKIN_INTERVAL_SEC * 4U;
+	dev_ctx.poll_control_attr.long_poll_interval = POLL_LONG_INTERVAL_MS / 250U;
+	dev_ctx.poll_control_attr.short_poll_interval = MAX(POLL_FAST_INTERVAL_MS / 250U, 1U);
+	dev_ctx.poll_control_attr.fast_poll_timeout = ZB_ZCL_POLL_CONTROL_FAST_POLL_TIMEOUT_DEFAULT_VALUE;
+	dev_ctx.poll_control_attr.checkin_interval_min = 0;
+	dev_ctx.poll_control_attr.long_poll_interval_min = 0;
+	dev_ctx.poll_control_attr.fast_poll_timeout_max = 0;
+#endif
+
+	/* Simple Metering: kWh x 1 / 1000000 = mWh resolution */
+	dev_ctx.metering_attr.status = 0;
+	dev_ctx.metering_attr.unit_of_measure = ZB_ZCL_METERING_UNIT_KW_KWH_BINARY;
+	dev_ctx.metering_attr.multiplier.low = 1;
+	dev_ctx.metering_attr.divisor.low = (uint16_t)(1000000U & 0xFFFFU);
+	dev_ctx.metering_attr.divisor.high = (uint8_t)(1000000U >> 16);
+	dev_ctx.metering_attr.summation_formatting = 0x33; /* 3 decimals */
+	dev_ctx.metering_attr.device_type = ZB_ZCL_METERING_ELECTRIC_METERING;
+
+	/* Level Control attributes */
+	dev_ctx.level_control_attr.current_level = ZB_ZCL_LEVEL_CONTROL_LEVEL_MAX_VALUE;
+	dev_ctx.level_control_attr.remaining_time = ZB_ZCL_LEVEL_CONTROL_REMAINING_TIME_DEFAULT_VALUE;
+	dev_ctx.level_control_attr.options = 0;
+	dev_ctx.level_control_attr.on_off_transition_time = 10; /* Default 1 second (in 1/10s units) */
+	dev_ctx.level_control_attr.start_up_current_level = ZB_ZCL_LEVEL_STARTUP_PREVIOUS;
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_ON_OFF,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+		(zb_uint8_t *)&dev_ctx.on_off_attr.on_off,
+		ZB_FALSE);
+
+	ZB_ZCL_SET_ATTRIBUTE(
+		LIGHT_ENDPOINT,
+		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+		ZB_ZCL_CLUSTER_SERVER_ROLE,
+		ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+		(zb_uint8_t *)&dev_ctx.level_control_attr.current_level,
+		ZB_FALSE);
+}
+
+/* ==========================================================================
+ * Startup Behavior
+ * ========================================================================== */
+
+static void apply_startup_behavior(void)
+{
+	zb_bool_t on_off_state;
+	zb_uint8_t level;
+
+	LOG_INF("Applying startup behavior (on_off: 0x%02x, level: 0x%02x)",
+		dev_ctx.on_off_attr.start_up_on_off,
+		dev_ctx.level_control_attr.start_up_current_level);
+
+	/* Determine startup level */
+	switch (dev_ctx.level_control_attr.start_up_current_level) {
+	case ZB_ZCL_LEVEL_STARTUP_MINIMUM:
+		level = ZB_ZCL_LEVEL_CONTROL_LEVEL_MIN_VALUE;
+		break;
+	case ZB_ZCL_LEVEL_STARTUP_PREVIOUS:
+		/* Keep current_level as-is (restored from NVS) */
+		level = dev_ctx.level_control_attr.current_level;
+		break;
+	default:
+		/* Specific level value */
+		level = dev_ctx.level_control_attr.start_up_current_level;
+		break;
+	}
+
+	/* Determine startup on/off state */
+	switch (dev_ctx.on_off_attr.start_up_on_off) {
+	case ZB_ZCL_ON_OFF_STARTUP_OFF:
+		on_off_state = ZB_FALSE;
+		break;
+	case ZB_ZCL_ON_OFF_STARTUP_ON:
+		on_off_state = ZB_TRUE;
+		break;
+	case ZB_ZCL_ON_OFF_STARTUP_TOGGLE:
+		on_off_state = !dev_ctx.on_off_attr.on_off;
+		break;
+	case ZB_ZCL_ON_OFF_STARTUP_PREVIOUS:
+	default:
+		/* Keep on_off as-is (restored from NVS) */
+		on_off_state = dev_ctx.on_off_attr.on_off;
+		break;
+	}
+
+	/* Apply the startup state */
+	dev_ctx.level_control_attr.current_level = level;
+	dev_ctx.on_off_attr.on_off = on_off_state;
+
+	if (on_off_state) {
+		light_set_brightness(level);
+		app_state.last_brightness = level;
+	} else {
+		light_set_brightness(0);
+	}
+
+	LOG_INF("Startup state: %s, level: %u",
+		on_off_state ? "ON" : "OFF", level);
+}
 
-#define BATTERY_CURVE_SIZE ARRAY_SIZE(lipo_discharge_curve)
+/* ==========================================================================
+ * Zigbee FOTA (Over-The-Air Updates)
+ * ========================================================================== */
 
-/**
- * Convert battery voltage (mV) to percentage using lookup table with interpolation.
+#ifdef CONFIG_ZIGBEE_FOTA
+
+/*
+ * Every image block costs a poll round trip on a sleepy device, so a
+ * download at the idle poll interval would take days. Each block received
+ * re-arms fast polling for OTA_POLL_HOLD_MS; if the server stalls for that
+ * long the device backs off to normal polling. Throughput is averaged over
+ * OTA_RATE_WINDOW_MS windows for the rate/ETA diagnostics. All of this
+ * runs on the ZBOSS thread.
  */
-static uint8_t battery_mv_to_percent(uint16_t mv)
+
+static struct {
+	uint32_t file_length;
+	uint32_t offset;
+	uint32_t window_offset;
+	int64_t  window_start;
+	uint32_t rate_bps;              /* Smoothed, 0 until the first window */
+	bool     active;
+} ota_dl;
+
+static void ota_dl_start(uint32_t file_length)
 {
-	if (mv >= lipo_discharge_curve[0].mv) {
-		return 100;
-	}
+	ota_dl.file_length = file_length;
+	ota_dl.offset = 0;
+	ota_dl.window_offset = 0;
+	ota_dl.window_start = k_uptime_get();
+	ota_dl.rate_bps = 0;
+	ota_dl.active = true;
+
+	LOG_INF("OTA download started: %u bytes", file_length);
+	poll_fast_for(OTA_POLL_HOLD_MS);
+}
 
-	if (mv <= lipo_discharge_curve[BATTERY_CURVE_SIZE - 1].mv) {
-		return 0;
+static void ota_dl_block(uint32_t file_offset, uint32_t length)
+{
+	int64_t now = k_uptime_get();
+	int64_t elapsed;
+
+	if (!ota_dl.active) {
+		return;
 	}
 
-	/* Find the two points to interpolate between */
-	for (size_t i = 0; i < BATTERY_CURVE_SIZE - 1; i++) {
-		if (mv >= lipo_discharge_curve[i + 1].mv) {
-			/* Linear interpolation */
-			uint16_t v_high = lipo_discharge_curve[i].mv;
-			uint16_t v_low = lipo_discharge_curve[i + 1].mv;
-			uint8_t p_high = lipo_discharge_curve[i].percent;
-			uint8_t p_low = lipo_discharge_curve[i + 1].percent;
+	ota_dl.offset = file_offset + length;
 
-			uint16_t v_range = v_high - v_low;
-			uint8_t p_range = p_high - p_low;
+	poll_fast_for(OTA_POLL_HOLD_MS);
 
-			return p_low + ((mv - v_low) * p_range) / v_range;
-		}
+	elapsed = now - ota_dl.window_start;
+	if (elapsed >= OTA_RATE_WINDOW_MS) {
+		uint32_t rate = (uint32_t)((uint64_t)(ota_dl.offset - ota_dl.window_offset) *
+					   1000U / (uint64_t)elapsed);
+
+		ota_dl.rate_bps = ota_dl.rate_bps ? (ota_dl.rate_bps * 3U + rate) / 4U : rate;
+		ota_dl.window_offset = ota_dl.offset;
+		ota_dl.window_start = now;
 	}
+}
 
-	return 0;
+static void ota_dl_end(void)
+{
+	if (ota_dl.active) {
+		LOG_INF("OTA download ended at %u/%u bytes, %u B/s",
+			ota_dl.offset, ota_dl.file_length, ota_dl.rate_bps);
+	}
+	ota_dl.active = false;
 }
 
 /**
- * Measure VDDH voltage using nRF52840 SAADC.
- * Returns voltage in millivolts.
+ * Watch the OTA client's progress before handing it to the FOTA library.
  */
-static uint16_t battery_measure_mv(void)
+static void ota_zcl_cb(zb_bufid_t bufid)
 {
-	int16_t sample;
-	uint16_t voltage_mv;
+	zb_zcl_device_callback_param_t *param = ZB_BUF_GET_PARAM(bufid, zb_zcl_device_callback_param_t);
+	zb_zcl_ota_upgrade_value_param_t *ota = &param->cb_param.ota_value_param;
 
-	if (!adc_dev) {
-		LOG_ERR("ADC not initialized");
-		return 0;
+	switch (ota->upgrade_status) {
+	case ZB_ZCL_OTA_UPGRADE_STATUS_START:
+		ota_dl_start(ota->upgrade.start.file_length);
+		break;
+	case ZB_ZCL_OTA_UPGRADE_STATUS_RECEIVE:
+		ota_dl_block(ota->upgrade.receive.file_offset, ota->upgrade.receive.data_length);
+		break;
+	case ZB_ZCL_OTA_UPGRADE_STATUS_CHECK:
+		ota_dl_end();
+		break;
+	default:
+		break;
 	}
 
-	/* Configure SAADC for VDD measurement
-	 * nRF52840 SAADC can measure VDD directly using internal channel
-	 * Input: VDD/5 (internal divider)
-	 * Reference: Internal 0.6V
-	 * Gain: 1/6
-	 * Resolution: 12-bit
-	 *
-	 * Voltage = (sample * reference * gain_divisor) / (resolution * input_divider)
-	 * Voltage = (sample * 0.6 * 6) / (4096 * 1/5)
-	 * Voltage = (sample * 3.6) / (4096 / 5)
-	 * Voltage = (sample * 3.6 * 5) / 4096
-	 * Voltage = sample * 18 / 4096 (in volts)
-	 * Voltage_mV = sample * 18000 / 4096
-	 */
+	zigbee_fota_zcl_cb(bufid);
+}
 
-	struct adc_channel_cfg channel_cfg = {
-		.gain = ADC_GAIN_1_6,
-		.reference = ADC_REF_INTERNAL,
-		.acquisition_time = ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 40),
-		.channel_id = 0,
-		.input_positive = SAADC_CH_PSELP_PSELP_VDD,
-	};
+/**
+ * Copy the download progress into the diagnostics attributes.
+ * Called lazily, right before the attributes are read.
+ */
+static void ota_update_attrs(void)
+{
+	uint32_t left = ota_dl.file_length - MIN(ota_dl.offset, ota_dl.file_length);
 
-	int ret = adc_channel_setup(adc_dev, &channel_cfg);
-	if (ret < 0) {
-		LOG_ERR("ADC channel setup failed: %d", ret);
-		return 0;
+	dev_ctx.diag_attr.ota_rate_bps = ota_dl.active ? ota_dl.rate_bps : 0;
+	dev_ctx.diag_attr.ota_eta_s = (ota_dl.active && ota_dl.rate_bps) ?
+		DIV_ROUND_UP(left, ota_dl.rate_bps) : 0;
+	dev_ctx.diag_attr.ota_offset = ota_dl.offset;
+}
+
+static void fota_evt_handler(const struct zigbee_fota_evt *evt)
+{
+	switch (evt->id) {
+	case ZIGBEE_FOTA_EVT_PROGRESS:
+		LOG_INF("OTA progress: %d%%", evt->dl.progress);
+		status_led_ota_progress(evt->dl.progress);
+		break;
+
+	case ZIGBEE_FOTA_EVT_FINISHED:
+		LOG_INF("OTA download complete, rebooting...");
+		ota_dl_end();
+		save_light_state_flush();
+		sys_reboot(SYS_REBOOT_COLD);
+		break;
+
+	case ZIGBEE_FOTA_EVT_ERROR:
+		LOG_ERR("OTA transfer failed");
+		ota_dl_end();
+		status_led_indicate(STATUS_LED_OTA, false);
+		break;
+
+	default:
+		break;
 	}
+}
 
-	struct adc_sequence sequence = {
-		.channels = BIT(0),
-		.buffer = &sample,
-		.buffer_size = sizeof(sample),
-		.resolution = 12,
-	};
+#else /* !CONFIG_ZIGBEE_FOTA */
 
-	ret = adc_read(adc_dev, &sequence);
-	if (ret < 0) {
-		LOG_ERR("ADC read failed: %d", ret);
-		return 0;
+static void ota_update_attrs(void)
+{
+}
+
+#endif /* CONFIG_ZIGBEE_FOTA */
+
+/* ==========================================================================
+ * Zigbee Callbacks
+ * ========================================================================== */
+
+/**
+ * Pre-process On/Off cluster commands before ZBOSS handles them.
+ * Returns ZB_TRUE if the command was fully handled (buffer consumed).
+ */
+static zb_uint8_t on_off_ep_handler(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info)
+{
+	if (cmd_info->is_common_command) {
+		/* Derive OnTime/OffWaitTime lazily, just before they are read */
+		if (cmd_info->cmd_id == ZB_ZCL_CMD_READ_ATTRIB) {
+			on_off_timed_refresh();
+		}
+		return ZB_FALSE;
 	}
 
-	/* Convert to millivolts
-	 * VDD measurement uses internal 1/5 divider and 0.6V reference
-	 * With gain 1/6: measured = VDD * (1/5) / (0.6 * 6) * 4096
-	 * VDD = measured * 0.6 * 6 * 5 / 4096
-	 * VDD_mV = measured * 18000 / 4096 = measured * 4.395
-	 */
-	voltage_mv = (uint32_t)sample * 18000U / 4096U;
+	switch (cmd_info->cmd_id) {
+	case ZB_ZCL_CMD_ON_OFF_OFF_ID:
+	case ZB_ZCL_CMD_ON_OFF_OFF_WITH_EFFECT_ID:
+		on_off_timed_handle_cmd(false);
+		return ZB_FALSE;
+
+	case ZB_ZCL_CMD_ON_OFF_ON_ID:
+	case ZB_ZCL_CMD_ON_OFF_ON_WITH_RECALL_GLOBAL_SCENE_ID:
+		on_off_timed_handle_cmd(true);
+		return ZB_FALSE;
+
+	case ZB_ZCL_CMD_ON_OFF_TOGGLE_ID:
+		on_off_timed_handle_cmd(!dev_ctx.on_off_attr.on_off);
+		return ZB_FALSE;
+
+	case ZB_ZCL_CMD_ON_OFF_ON_WITH_TIMED_OFF_ID: {
+		zb_zcl_parsed_hdr_t cmd_copy = *cmd_info;
+		const uint8_t *payload = zb_buf_begin(bufid);
+		zb_zcl_status_t status = ZB_ZCL_STATUS_SUCCESS;
+
+		/* Payload: control (u8), on time (u16), off wait time (u16) */
+		if (zb_buf_len(bufid) < 5) {
+			status = ZB_ZCL_STATUS_MALFORMED_CMD;
+			latency_probe_cancel();
+		} else {
+			on_off_with_timed_off(payload[0],
+					      sys_get_le16(&payload[1]),
+					      sys_get_le16(&payload[3]));
+		}
 
-	LOG_DBG("Battery ADC: %d -> %u mV", sample, voltage_mv);
+		zb_zcl_send_default_handler(bufid, &cmd_copy, status);
+		return ZB_TRUE;
+	}
 
-	return voltage_mv;
+	default:
+		return ZB_FALSE;
+	}
 }
 
 /**
- * Update battery attributes and report to coordinator.
+ * Level Control cluster: Move to Level (with On/Off) becomes one fade, see
+ * level_move_start(). ZBOSS still processes the command: it steps
+ * CurrentLevel, couples On/Off and sends the response.
  */
-static void battery_update_and_report(void)
+static zb_uint8_t level_ep_handler(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info)
 {
-	uint16_t voltage_mv = battery_measure_mv();
+	const uint8_t *payload = zb_buf_begin(bufid);
+	bool with_on_off;
 
-	if (voltage_mv == 0) {
-		LOG_WRN("Battery measurement failed");
-		return;
+	if (cmd_info->is_common_command) {
+		return ZB_FALSE;
 	}
 
-	uint8_t percent = battery_mv_to_percent(voltage_mv);
+	switch (cmd_info->cmd_id) {
+	case ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL:
+		with_on_off = false;
+		break;
 
-	/* Update attributes
-	 * battery_voltage is in units of 100mV (ZCL spec)
-	 * battery_percentage is 0-200 (0.5% per unit, so 200 = 100%)
-	 */
-	dev_ctx.power_config_attr.battery_voltage = voltage_mv / 100;
-	dev_ctx.power_config_attr.battery_percentage = percent * 2; /* Convert to 0.5% units */
+	case ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF:
+		with_on_off = true;
+		break;
 
-	LOG_INF("Battery: %u mV (%u%%)", voltage_mv, percent);
+	case ZB_ZCL_CMD_LEVEL_CONTROL_STOP:
+	case ZB_ZCL_CMD_LEVEL_CONTROL_STOP_WITH_ON_OFF:
+		level_move_stop();
+		return ZB_FALSE;
 
-	/* Report to coordinator if joined */
-	if (ZB_JOINED()) {
-		ZB_ZCL_SET_ATTRIBUTE(
-			BATTERY_ENDPOINT,
-			ZB_ZCL_CLUSTER_ID_POWER_CONFIG,
-			ZB_ZCL_CLUSTER_SERVER_ROLE,
-			ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_ID,
-			(zb_uint8_t *)&dev_ctx.power_config_attr.battery_voltage,
-			ZB_FALSE);
+	default:
+		return ZB_FALSE;
+	}
+
+	/* Payload: level (u8), transition time (u16, 1/10 s); ZBOSS rejects short ones */
+	if (zb_buf_len(bufid) < 3) {
+		return ZB_FALSE;
+	}
+
+	uint8_t level = payload[0];
+	uint16_t transition = sys_get_le16(&payload[1]);
 
-		LOG_DBG("Battery level reported");
+	if (transition == 0xFFFFU) {
+		transition = dev_ctx.level_control_attr.on_off_transition_time;
+	}
+	if (transition == 0xFFFFU) {
+		transition = 0;
+	}
+
+	if (with_on_off) {
+		/* Reaching the minimum level switches the light off */
+		if (level <= 1U) {
+			level = 0;
+		}
+	} else if (!dev_ctx.on_off_attr.on_off) {
+		/* Nothing to fade while off, the step writes are handled as before */
+		return ZB_FALSE;
+	} else {
+		level = MAX(level, 1U);
 	}
+
+	level_move_start(level, (uint32_t)transition * 100U);
+	return ZB_FALSE;
 }
 
 /**
- * Battery report work handler - called periodically.
+ * Scene (and other cluster) responses are only sent for unicast requests.
  */
-static void battery_work_handler(struct k_work *work)
+static bool zcl_cmd_is_unicast(const zb_zcl_parsed_hdr_t *cmd_info)
 {
-	ARG_UNUSED(work);
-
-	battery_update_and_report();
-
-	/* Reschedule for next report */
-	k_work_schedule(&battery_work, K_SECONDS(BATTERY_REPORT_INTERVAL_SEC));
+	return ZB_APS_FC_GET_DELIVERY_MODE(ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).fc) ==
+	       ZB_APS_DELIVERY_MODE_UNICAST;
 }
 
 /**
- * Initialize battery measurement.
+ * Start a cluster-specific response in the request buffer.
  */
-static int battery_init(void)
+static zb_uint8_t *zcl_response_start(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info,
+				      zb_uint8_t cmd_id)
 {
-	adc_dev = DEVICE_DT_GET(DT_NODELABEL(adc));
-	if (!device_is_ready(adc_dev)) {
-		LOG_ERR("ADC device not ready");
-		return -ENODEV;
-	}
-
-	/* Initialize power config attributes */
-	dev_ctx.power_config_attr.battery_voltage = 0;
-	dev_ctx.power_config_attr.battery_percentage = 0;
-	dev_ctx.power_config_attr.battery_size = ZB_ZCL_POWER_CONFIG_BATTERY_SIZE_OTHER; /* LiPo */
-	dev_ctx.power_config_attr.battery_quantity = 1;
-	dev_ctx.power_config_attr.battery_rated_voltage = 37; /* 3.7V nominal in 100mV units */
-	dev_ctx.power_config_attr.battery_alarm_mask = 0;
-	dev_ctx.power_config_attr.battery_voltage_min_threshold = 30; /* 3.0V in 100mV units */
-
-	/* Initialize work item */
-	k_work_init_delayable(&battery_work, battery_work_handler);
+	zb_uint8_t *cmd_ptr = ZB_ZCL_START_PACKET(bufid);
 
-	LOG_INF("Battery measurement initialized");
+	ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(cmd_ptr);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER(cmd_ptr, cmd_info->seq_number, cmd_id);
 
-	return 0;
+	return cmd_ptr;
 }
 
 /**
- * Start periodic battery reporting.
- * Called after network join.
+ * Finish a response started with zcl_response_start() and send it back
+ * to the requester.
  */
-static void battery_start_reporting(void)
+static void zcl_response_send(zb_bufid_t bufid, zb_uint8_t *cmd_ptr,
+			      const zb_zcl_parsed_hdr_t *cmd_info)
 {
-	/* Do an immediate measurement and report */
-	battery_update_and_report();
+	ZB_ZCL_FINISH_PACKET(bufid, cmd_ptr)
+	ZB_ZCL_SEND_COMMAND_SHORT(
+		bufid,
+		ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).source.u.short_addr,
+		ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+		ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).src_endpoint,
+		ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).dst_endpoint,
+		cmd_info->profile_id,
+		cmd_info->cluster_id,
+		NULL);
+}
 
-	/* Schedule periodic reports */
-	k_work_schedule(&battery_work, K_SECONDS(BATTERY_REPORT_INTERVAL_SEC));
+/**
+ * Parse the extension field sets of an Add Scene request into a scene.
+ */
+static bool scene_parse_extensions(struct light_scene *s, const uint8_t *data, size_t len)
+{
+	while (len >= 3) {
+		uint16_t cluster_id = sys_get_le16(data);
+		uint8_t ext_len = data[2];
+
+		data += 3;
+		len -= 3;
+		if (ext_len > len) {
+			return false;
+		}
 
-	LOG_INF("Battery reporting started (interval: %u sec)", BATTERY_REPORT_INTERVAL_SEC);
-}
+		if (cluster_id == ZB_ZCL_CLUSTER_ID_ON_OFF && ext_len >= 1) {
+			s->flags |= SCENE_FLAG_HAS_ON_OFF;
+			if (data[0]) {
+				s->flags |= SCENE_FLAG_ON;
+			}
+		} else if (cluster_id == ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL && ext_len >= 1) {
+			s->flags |= SCENE_FLAG_HAS_LEVEL;
+			s->level = data[0];
+		}
 
-/* ==========================================================================
- * Status LED - Blinks when not joined, off when joined
- * ========================================================================== */
+		data += ext_len;
+		len -= ext_len;
+	}
 
-static struct k_work_delayable status_led_work;
+	return true;
+}
 
-static void status_led_work_handler(struct k_work *work)
+static zb_uint8_t scene_add(uint16_t group_id, uint8_t scene_id,
+			    const uint8_t *payload, size_t len)
 {
-	ARG_UNUSED(work);
+	/* Payload after group/scene: transition (u16), name (string), extensions */
+	if (len < 3 || (size_t)3 + payload[2] > len) {
+		return ZB_ZCL_STATUS_MALFORMED_CMD;
+	}
 
-	if (!device_is_ready(status_led.port)) {
-		return;
+	/* Add Scene gives whole seconds, the table keeps 1/10 s */
+	struct light_scene scene = {
+		.group_id = group_id,
+		.scene_id = scene_id,
+		.flags = SCENE_FLAG_USED,
+		.effect = ZB_ZCL_IDENTIFY_EFFECT_ID_STOP,
+		.transition_time = MIN((uint32_t)sys_get_le16(payload) * 10U, UINT16_MAX),
+	};
+	size_t name_end = 3 + payload[2];
+
+	if (!scene_parse_extensions(&scene, payload + name_end, len - name_end)) {
+		return ZB_ZCL_STATUS_MALFORMED_CMD;
 	}
 
-	if (ZB_JOINED()) {
-		/* Joined - LED off, stop blinking */
-		gpio_pin_set_dt(&status_led, 0);
-	} else {
-		/* Not joined - toggle LED and reschedule */
-		gpio_pin_toggle_dt(&status_led);
-		k_work_schedule(&status_led_work, K_MSEC(500));
+	int slot = scene_find(group_id, scene_id, true);
+
+	if (slot < 0) {
+		return ZB_ZCL_STATUS_INSUFF_SPACE;
 	}
+
+	scene_table[slot] = scene;
+	scene_save_slot(slot);
+	scene_update_count();
+
+	LOG_INF("Scene added: group 0x%04x scene %u (slot %d)", group_id, scene_id, slot);
+	return ZB_ZCL_STATUS_SUCCESS;
 }
 
-static void update_status_led(void)
+/**
+ * Scenes cluster server. The whole cluster is handled here so ZBOSS never
+ * touches its own scene storage.
+ */
+static zb_uint8_t scenes_ep_handler(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info)
 {
-	if (!device_is_ready(status_led.port)) {
-		return;
+	zb_zcl_parsed_hdr_t cmd = *cmd_info;
+	const uint8_t *payload = zb_buf_begin(bufid);
+	size_t len = zb_buf_len(bufid);
+	zb_uint8_t status = ZB_ZCL_STATUS_SUCCESS;
+	zb_uint8_t *cmd_ptr;
+	uint16_t group_id;
+	uint8_t scene_id;
+
+	if (cmd.is_common_command) {
+		return ZB_FALSE;
 	}
 
-	if (ZB_JOINED()) {
-		/* Joined - ensure LED is off and stop blinking */
-		k_work_cancel_delayable(&status_led_work);
-		gpio_pin_set_dt(&status_led, 0);
-	} else {
-		/* Not joined - start blinking if not already */
-		if (!k_work_delayable_is_pending(&status_led_work)) {
-			k_work_schedule(&status_led_work, K_NO_WAIT);
-		}
+	/* Only a successful recall drives the light */
+	if (cmd.cmd_id != ZB_ZCL_CMD_SCENES_RECALL_SCENE) {
+		latency_probe_cancel();
 	}
-}
-
-/* ==========================================================================
- * Button Handling
- * ========================================================================== */
 
-static void button_work_handler(struct k_work *work)
-{
-	ARG_UNUSED(work);
+	switch (cmd.cmd_id) {
+	case ZB_ZCL_CMD_SCENES_ADD_SCENE:
+	case ZB_ZCL_CMD_SCENES_VIEW_SCENE:
+	case ZB_ZCL_CMD_SCENES_REMOVE_SCENE:
+	case ZB_ZCL_CMD_SCENES_STORE_SCENE:
+	case ZB_ZCL_CMD_SCENES_RECALL_SCENE:
+		if (len < 3) {
+			zb_zcl_send_default_handler(bufid, &cmd, ZB_ZCL_STATUS_MALFORMED_CMD);
+			return ZB_TRUE;
+		}
+		group_id = sys_get_le16(payload);
+		scene_id = payload[2];
+		break;
 
-	bool pressed = (gpio_pin_get_dt(&button) == 1);
+	case ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES:
+	case ZB_ZCL_CMD_SCENES_GET_SCENE_MEMBERSHIP:
+		if (len < 2) {
+			zb_zcl_send_default_handler(bufid, &cmd, ZB_ZCL_STATUS_MALFORMED_CMD);
+			return ZB_TRUE;
+		}
+		group_id = sys_get_le16(payload);
+		scene_id = 0;
+		break;
 
-	if (pressed && !app_state.pressed) {
-		/* Button pressed */
-		app_state.pressed = true;
-		app_state.press_time = k_uptime_get();
-		k_work_schedule(&long_press_work, K_MSEC(BUTTON_LONG_PRESS_MS));
-		LOG_DBG("Button pressed");
-	} else if (!pressed && app_state.pressed) {
-		/* Button released */
-		app_state.pressed = false;
-		k_work_cancel_delayable(&long_press_work);
+	default:
+		/* Enhanced/copy scene: let ZBOSS reject them */
+		return ZB_FALSE;
+	}
 
-		int64_t duration = k_uptime_get() - app_state.press_time;
-		if (duration < BUTTON_LONG_PRESS_MS) {
-			LOG_INF("Short press - toggle");
-			light_toggle();
-		}
-		LOG_DBG("Button released after %lld ms", duration);
+	if (group_id != 0 && !group_is_member(group_id)) {
+		status = ZB_ZCL_STATUS_INVALID_FIELD;
 	}
-}
 
-static void long_press_work_handler(struct k_work *work)
-{
-	ARG_UNUSED(work);
+	switch (cmd.cmd_id) {
+	case ZB_ZCL_CMD_SCENES_ADD_SCENE:
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			status = scene_add(group_id, scene_id, payload + 3, len - 3);
+		}
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd, ZB_ZCL_CMD_SCENES_ADD_SCENE_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, scene_id);
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
+
+	case ZB_ZCL_CMD_SCENES_VIEW_SCENE: {
+		int slot = -1;
+
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			slot = scene_find(group_id, scene_id, false);
+			if (slot < 0) {
+				status = ZB_ZCL_STATUS_NOT_FOUND;
+			}
+		}
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd, ZB_ZCL_CMD_SCENES_VIEW_SCENE_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, scene_id);
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			const struct light_scene *s = &scene_table[slot];
+
+			/* View Scene answers in seconds, like Add Scene */
+			ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, s->transition_time / 10U);
+			ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, 0); /* Scene names not supported */
+			if (s->flags & SCENE_FLAG_HAS_ON_OFF) {
+				ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, ZB_ZCL_CLUSTER_ID_ON_OFF);
+				ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, 1);
+				ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, (s->flags & SCENE_FLAG_ON) ? 1 : 0);
+			}
+			if (s->flags & SCENE_FLAG_HAS_LEVEL) {
+				ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL);
+				ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, 1);
+				ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, s->level);
+			}
+		}
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
+	}
 
-	if (app_state.pressed) {
-		LOG_INF("Long press - factory reset");
+	case ZB_ZCL_CMD_SCENES_REMOVE_SCENE:
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			int slot = scene_find(group_id, scene_id, false);
 
-		/* Leave network and restart steering */
-		if (ZB_JOINED()) {
-			zb_bdb_reset_via_local_action(0);
+			if (slot < 0) {
+				status = ZB_ZCL_STATUS_NOT_FOUND;
+			} else {
+				scene_remove_slot(slot);
+				scene_update_count();
+			}
+		}
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd, ZB_ZCL_CMD_SCENES_REMOVE_SCENE_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, scene_id);
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
+
+	case ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES:
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			scene_remove_group(group_id);
+		}
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd, ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
+
+	case ZB_ZCL_CMD_SCENES_STORE_SCENE:
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			status = scene_store(group_id, scene_id);
+		}
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd, ZB_ZCL_CMD_SCENES_STORE_SCENE_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, scene_id);
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
+
+	case ZB_ZCL_CMD_SCENES_RECALL_SCENE:
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			/* Optional transition time override (ZCL 7) */
+			uint16_t transition = (len >= 5) ?
+				sys_get_le16(payload + 3) : SCENE_RECALL_TRANSITION_UNSET;
+
+			status = scene_recall(group_id, scene_id, transition);
+		}
+		if (status != ZB_ZCL_STATUS_SUCCESS) {
+			latency_probe_cancel();
 		}
+		zb_zcl_send_default_handler(bufid, &cmd, status);
+		return ZB_TRUE;
 
-		/* Blink LED to indicate reset */
-		for (int i = 0; i < 6; i++) {
-			gpio_pin_toggle_dt(&status_led);
-			k_msleep(100);
+	case ZB_ZCL_CMD_SCENES_GET_SCENE_MEMBERSHIP: {
+		uint8_t ids[SCENE_TABLE_SIZE];
+		uint8_t count = 0;
+
+		if (!zcl_cmd_is_unicast(&cmd)) {
+			break;
+		}
+		for (size_t i = 0; i < SCENE_TABLE_SIZE; i++) {
+			if ((scene_table[i].flags & SCENE_FLAG_USED) &&
+			    scene_table[i].group_id == group_id) {
+				ids[count++] = scene_table[i].scene_id;
+			}
+		}
+		cmd_ptr = zcl_response_start(bufid, &cmd,
+					     ZB_ZCL_CMD_SCENES_GET_SCENE_MEMBERSHIP_RESPONSE);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, status);
+		ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, SCENE_TABLE_SIZE - dev_ctx.scenes_attr.scene_count);
+		ZB_ZCL_PACKET_PUT_DATA16_VAL(cmd_ptr, group_id);
+		if (status == ZB_ZCL_STATUS_SUCCESS) {
+			ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, count);
+			for (uint8_t i = 0; i < count; i++) {
+				ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, ids[i]);
+			}
 		}
+		zcl_response_send(bufid, cmd_ptr, &cmd);
+		return ZB_TRUE;
 	}
-}
 
-static void button_gpio_handler(const struct device *dev,
-				struct gpio_callback *cb,
-				uint32_t pins)
-{
-	ARG_UNUSED(dev);
-	ARG_UNUSED(cb);
-	ARG_UNUSED(pins);
+	default:
+		break;
+	}
 
-	k_work_submit(&button_work);
+	/* Group/broadcast request: no response */
+	zb_buf_free(bufid);
+	return ZB_TRUE;
 }
 
-static int button_init(void)
+/**
+ * Groups cluster: ZBOSS owns the APS group table, we only mirror changes
+ * into the membership cache and drop scenes of removed groups.
+ */
+static zb_uint8_t groups_ep_handler(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info)
 {
-	int ret;
+	const uint8_t *payload = zb_buf_begin(bufid);
+	size_t len = zb_buf_len(bufid);
 
-	if (!device_is_ready(button.port)) {
-		LOG_ERR("Button device not ready");
-		return -ENODEV;
+	if (cmd_info->is_common_command) {
+		return ZB_FALSE;
 	}
 
-	ret = gpio_pin_configure_dt(&button, GPIO_INPUT);
-	if (ret < 0) {
-		LOG_ERR("Button config failed: %d", ret);
-		return ret;
-	}
+	/* ZBOSS may accept a group the cache has no room for */
+	group_miss_clear();
 
-	ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
-	if (ret < 0) {
-		LOG_ERR("Button interrupt config failed: %d", ret);
-		return ret;
-	}
+	switch (cmd_info->cmd_id) {
+	case ZB_ZCL_CMD_GROUPS_ADD_GROUP:
+		if (len >= 2) {
+			group_cache_add(sys_get_le16(payload));
+			ZB_SCHEDULE_APP_CALLBACK(group_cache_verify, 0);
+		}
+		break;
 
-	gpio_init_callback(&button_cb_data, button_gpio_handler, BIT(button.pin));
-	ret = gpio_add_callback(button.port, &button_cb_data);
-	if (ret < 0) {
-		LOG_ERR("Button callback add failed: %d", ret);
-		return ret;
-	}
+	case ZB_ZCL_CMD_GROUPS_ADD_GROUP_IF_IDENTIFYING:
+		if (len >= 2 && dev_ctx.identify_attr.identify_time > 0) {
+			group_cache_add(sys_get_le16(payload));
+			ZB_SCHEDULE_APP_CALLBACK(group_cache_verify, 0);
+		}
+		break;
 
-	k_work_init(&button_work, button_work_handler);
-	k_work_init_delayable(&long_press_work, long_press_work_handler);
+	case ZB_ZCL_CMD_GROUPS_REMOVE_GROUP:
+		if (len >= 2) {
+			uint16_t group_id = sys_get_le16(payload);
 
-	LOG_INF("Button initialized on P0.%u", button.pin);
-	return 0;
-}
+			group_cache_remove(group_id);
+			scene_remove_group(group_id);
+		}
+		break;
 
-/* ==========================================================================
- * Zigbee Attribute Initialization
- * ========================================================================== */
+	case ZB_ZCL_CMD_GROUPS_REMOVE_ALL_GROUPS:
+		for (uint8_t i = 0; i < group_count; i++) {
+			scene_remove_group(group_ids[i]);
+		}
+		group_cache_clear();
+		break;
 
-static void clusters_attr_init(void)
-{
-	dev_ctx.basic_attr.zcl_version = ZB_ZCL_VERSION;
-	dev_ctx.basic_attr.app_version = BULB_INIT_BASIC_APP_VERSION;
-	dev_ctx.basic_attr.stack_version = BULB_INIT_BASIC_STACK_VERSION;
-	dev_ctx.basic_attr.hw_version = BULB_INIT_BASIC_HW_VERSION;
-	dev_ctx.basic_attr.power_source = ZB_ZCL_BASIC_POWER_SOURCE_BATTERY;
-	dev_ctx.basic_attr.ph_env = BULB_INIT_BASIC_PH_ENV;
+	default:
+		break;
+	}
 
-	ZB_ZCL_SET_STRING_VAL(
-		dev_ctx.basic_attr.mf_name,
-		BULB_INIT_BASIC_MANUF_NAME,
-		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_MANUF_NAME));
+	/* Let ZBOSS update its group table and send the response */
+	return ZB_FALSE;
+}
 
-	ZB_ZCL_SET_STRING_VAL(
-		dev_ctx.basic_attr.model_id,
-		BULB_INIT_BASIC_MODEL_ID,
-		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_MODEL_ID));
+#ifdef LIGHT_ROLE_SLEEPY
+/**
+ * Poll Control cluster server commands, driving the adaptive poll controller.
+ */
+static zb_uint8_t poll_control_ep_handler(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info)
+{
+	zb_zcl_parsed_hdr_t cmd = *cmd_info;
+	const uint8_t *payload = zb_buf_begin(bufid);
+	size_t len = zb_buf_len(bufid);
+	zb_uint8_t status = ZB_ZCL_STATUS_SUCCESS;
+	poll_control_attrs_t *attr = &dev_ctx.poll_control_attr;
+
+	if (cmd.is_common_command) {
+		return ZB_FALSE;
+	}
 
-	ZB_ZCL_SET_STRING_VAL(
-		dev_ctx.basic_attr.date_code,
-		BULB_INIT_BASIC_DATE_CODE,
-		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_DATE_CODE));
+	switch (cmd.cmd_id) {
+	case ZB_ZCL_CMD_POLL_CONTROL_CHECK_IN_RESPONSE_ID:
+		if (len < 3) {
+			status = ZB_ZCL_STATUS_MALFORMED_CMD;
+			break;
+		}
+		if (attr->fast_poll_timeout_max && sys_get_le16(&payload[1]) > attr->fast_poll_timeout_max) {
+			status = ZB_ZCL_STATUS_INVALID_VALUE;
+			break;
+		}
+		poll_checkin_response(payload[0] != 0, sys_get_le16(&payload[1]));
+		break;
 
-	ZB_ZCL_SET_STRING_VAL(
-		dev_ctx.basic_attr.location_id,
-		BULB_INIT_BASIC_LOCATION_DESC,
-		ZB_ZCL_STRING_CONST_SIZE(BULB_INIT_BASIC_LOCATION_DESC));
+	case ZB_ZCL_CMD_POLL_CONTROL_FAST_POLL_STOP_ID:
+		status = poll_fast_stop();
+		break;
 
-	dev_ctx.identify_attr.identify_time = ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE;
+	case ZB_ZCL_CMD_POLL_CONTROL_SET_LONG_POLL_INTERVAL_ID: {
+		if (len < 4) {
+			status = ZB_ZCL_STATUS_MALFORMED_CMD;
+			break;
+		}
+		uint32_t interval = sys_get_le32(payload);
 
-	/* On/Off attributes */
-	dev_ctx.on_off_attr.on_off = ZB_ZCL_ON_OFF_IS_OFF;
-	dev_ctx.on_off_attr.global_scene_ctrl = ZB_TRUE;
-	dev_ctx.on_off_attr.on_time = 0;
-	dev_ctx.on_off_attr.off_wait_time = 0;
-	dev_ctx.on_off_attr.start_up_on_off = ZB_ZCL_ON_OFF_STARTUP_PREVIOUS;
+		if (interval < attr->short_poll_interval || interval < attr->long_poll_interval_min ||
+		    (attr->checkin_interval && interval > attr->checkin_interval)) {
+			status = ZB_ZCL_STATUS_INVALID_VALUE;
+			break;
+		}
+		attr->long_poll_interval = interval;
+		poll_bounds_changed();
+		LOG_INF("Poll Control: long poll %u ms", poll_long_ms());
+		break;
+	}
 
-	/* Level Control attributes */
-	dev_ctx.level_control_attr.current_level = ZB_ZCL_LEVEL_CONTROL_LEVEL_MAX_VALUE;
-	dev_ctx.level_control_attr.remaining_time = ZB_ZCL_LEVEL_CONTROL_REMAINING_TIME_DEFAULT_VALUE;
-	dev_ctx.level_control_attr.options = 0;
-	dev_ctx.level_control_attr.on_off_transition_time = 10; /* Default 1 second (in 1/10s units) */
-	dev_ctx.level_control_attr.start_up_current_level = ZB_ZCL_LEVEL_STARTUP_PREVIOUS;
+	case ZB_ZCL_CMD_POLL_CONTROL_SET_SHORT_POLL_INTERVAL_ID: {
+		if (len < 2) {
+			status = ZB_ZCL_STATUS_MALFORMED_CMD;
+			break;
+		}
+		uint16_t interval = sys_get_le16(payload);
 
-	ZB_ZCL_SET_ATTRIBUTE(
-		LIGHT_ENDPOINT,
-		ZB_ZCL_CLUSTER_ID_ON_OFF,
-		ZB_ZCL_CLUSTER_SERVER_ROLE,
-		ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
-		(zb_uint8_t *)&dev_ctx.on_off_attr.on_off,
-		ZB_FALSE);
+		if (interval == 0 || interval > attr->long_poll_interval) {
+			status = ZB_ZCL_STATUS_INVALID_VALUE;
+			break;
+		}
+		attr->short_poll_interval = interval;
+		poll_bounds_changed();
+		LOG_INF("Poll Control: short poll %u ms", poll_fast_ms());
+		break;
+	}
 
-	ZB_ZCL_SET_ATTRIBUTE(
-		LIGHT_ENDPOINT,
-		ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
-		ZB_ZCL_CLUSTER_SERVER_ROLE,
-		ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
-		(zb_uint8_t *)&dev_ctx.level_control_attr.current_level,
-		ZB_FALSE);
-}
+	default:
+		return ZB_FALSE;
+	}
 
-/* ==========================================================================
- * Startup Behavior
- * ========================================================================== */
+	zb_zcl_send_default_handler(bufid, &cmd, status);
+	return ZB_TRUE;
+}
+#endif
 
-static void apply_startup_behavior(void)
+/**
+ * APS data indication hook - runs for every incoming frame before ZCL
+ * parsing. Group frames for groups we are not in are dropped here.
+ */
+static zb_uint8_t aps_data_indication_cb(zb_bufid_t bufid)
 {
-	zb_bool_t on_off_state;
-	zb_uint8_t level;
+	zb_apsde_data_indication_t *ind = ZB_BUF_GET_PARAM(bufid, zb_apsde_data_indication_t);
+	bool group = ZB_APS_FC_GET_DELIVERY_MODE(ind->fc) == ZB_APS_DELIVERY_MODE_GROUP;
+	int8_t group_idx = -1;
 
-	LOG_INF("Applying startup behavior (on_off: 0x%02x, level: 0x%02x)",
-		dev_ctx.on_off_attr.start_up_on_off,
-		dev_ctx.level_control_attr.start_up_current_level);
+	prof_event(PROF_ZBOSS);
 
-	/* Determine startup level */
-	switch (dev_ctx.level_control_attr.start_up_current_level) {
-	case ZB_ZCL_LEVEL_STARTUP_MINIMUM:
-		level = ZB_ZCL_LEVEL_CONTROL_LEVEL_MIN_VALUE;
-		break;
-	case ZB_ZCL_LEVEL_STARTUP_PREVIOUS:
-		/* Keep current_level as-is (restored from NVS) */
-		level = dev_ctx.level_control_attr.current_level;
-		break;
-	default:
-		/* Specific level value */
-		level = dev_ctx.level_control_attr.start_up_current_level;
-		break;
+	if (group) {
+		if (!group_is_member(ind->group_addr)) {
+			LOG_DBG("Group 0x%04x: not a member, dropped", ind->group_addr);
+			zb_buf_free(bufid);
+			return ZB_TRUE;
+		}
+		group_idx = group_cache_find(ind->group_addr);
 	}
 
-	/* Determine startup on/off state */
-	switch (dev_ctx.on_off_attr.start_up_on_off) {
-	case ZB_ZCL_ON_OFF_STARTUP_OFF:
-		on_off_state = ZB_FALSE;
-		break;
-	case ZB_ZCL_ON_OFF_STARTUP_ON:
-		on_off_state = ZB_TRUE;
-		break;
-	case ZB_ZCL_ON_OFF_STARTUP_TOGGLE:
-		on_off_state = !dev_ctx.on_off_attr.on_off;
-		break;
-	case ZB_ZCL_ON_OFF_STARTUP_PREVIOUS:
-	default:
-		/* Keep on_off as-is (restored from NVS) */
-		on_off_state = dev_ctx.on_off_attr.on_off;
-		break;
+	/* Counted after the group filter, foreign group traffic is not ours */
+	energy_frame();
+
+	if (!group && ind->dst_endpoint != LIGHT_ENDPOINT) {
+		return ZB_FALSE;
 	}
 
-	/* Apply the startup state */
-	dev_ctx.level_control_attr.current_level = level;
-	dev_ctx.on_off_attr.on_off = on_off_state;
+	/* Received traffic for us - expect more, poll fast for a while */
+	poll_activity();
 
-	if (on_off_state) {
-		light_set_brightness(level);
-		app_state.last_brightness = level;
-	} else {
-		light_set_brightness(0);
+	/* Start a latency measurement for anything that can change the light */
+	if (ind->clusterid == ZB_ZCL_CLUSTER_ID_ON_OFF ||
+	    ind->clusterid == ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL ||
+	    ind->clusterid == ZB_ZCL_CLUSTER_ID_SCENES) {
+		latency_probe_rx(group_idx);
 	}
 
-	LOG_INF("Startup state: %s, level: %u",
-		on_off_state ? "ON" : "OFF", level);
+	return ZB_FALSE;
 }
 
-/* ==========================================================================
- * Zigbee FOTA (Over-The-Air Updates)
- * ========================================================================== */
-
-#ifdef CONFIG_ZIGBEE_FOTA
-static void fota_evt_handler(const struct zigbee_fota_evt *evt)
+/**
+ * Endpoint handler - sees every ZCL command for the light endpoint
+ * before the ZBOSS cluster handlers do.
+ */
+static zb_uint8_t light_ep_handler(zb_bufid_t bufid)
 {
-	switch (evt->id) {
-	case ZIGBEE_FOTA_EVT_PROGRESS:
-		LOG_INF("OTA progress: %d%%", evt->dl.progress);
-		/* Blink status LED during download */
-		if (device_is_ready(status_led.port)) {
-			gpio_pin_toggle_dt(&status_led);
-		}
-		break;
+	zb_zcl_parsed_hdr_t *cmd_info = ZB_BUF_GET_PARAM(bufid, zb_zcl_parsed_hdr_t);
 
-	case ZIGBEE_FOTA_EVT_FINISHED:
-		LOG_INF("OTA download complete, rebooting...");
-		sys_reboot(SYS_REBOOT_COLD);
-		break;
+	if (cmd_info->cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV) {
+		return ZB_FALSE;
+	}
 
-	case ZIGBEE_FOTA_EVT_ERROR:
-		LOG_ERR("OTA transfer failed");
-		break;
+	/* Reads/reporting config never reach the PWM, don't count them */
+	if (cmd_info->is_common_command) {
+		latency_probe_cancel();
+	}
 
+	switch (cmd_info->cluster_id) {
+	case ZB_ZCL_CLUSTER_ID_ON_OFF:
+		return on_off_ep_handler(bufid, cmd_info);
+	case ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+		return level_ep_handler(bufid, cmd_info);
+	case ZB_ZCL_CLUSTER_ID_SCENES:
+		return scenes_ep_handler(bufid, cmd_info);
+	case ZB_ZCL_CLUSTER_ID_GROUPS:
+		return groups_ep_handler(bufid, cmd_info);
+#ifdef LIGHT_ROLE_SLEEPY
+	case ZB_ZCL_CLUSTER_ID_POLL_CONTROL:
+		return poll_control_ep_handler(bufid, cmd_info);
+#endif
+	case ZB_ZCL_CLUSTER_ID_LIGHT_DIAGNOSTICS:
+		if (cmd_info->is_common_command && cmd_info->cmd_id == ZB_ZCL_CMD_READ_ATTRIB) {
+			latency_update_attrs();
+			group_update_attrs();
+			poll_update_attrs();
+			energy_update_attrs();
+			prof_update_attrs();
+			wq_update_attrs();
+			light_cmd_update_attrs();
+			report_update_attrs();
+			ota_update_attrs();
+		}
+		return ZB_FALSE;
+	case ZB_ZCL_CLUSTER_ID_METERING:
+		if (cmd_info->is_common_command && cmd_info->cmd_id == ZB_ZCL_CMD_READ_ATTRIB) {
+			energy_update_attrs();
+		}
+		return ZB_FALSE;
 	default:
-		break;
+		return ZB_FALSE;
 	}
 }
-#endif
-
-/* ==========================================================================
- * Zigbee Callbacks
- * ========================================================================== */
 
 static void zcl_device_cb(zb_bufid_t bufid)
 {
 	zb_zcl_device_callback_param_t *param =
 		ZB_BUF_GET_PARAM(bufid, zb_zcl_device_callback_param_t);
 
+	latency_probe(LATENCY_STAGE_ZCL);
+
 	param->status = RET_OK;
 
 	switch (param->device_cb_id) {
@@ -1405,8 +6172,25 @@ static void zcl_device_cb(zb_bufid_t bufid)
 	case ZB_ZCL_SET_ATTR_VALUE_CB_ID:
 		if (param->cb_param.set_attr_value_param.cluster_id ==
 		    ZB_ZCL_CLUSTER_ID_ON_OFF) {
-			on_off_set_value(
-				(zb_bool_t)param->cb_param.set_attr_value_param.values.data8);
+			switch (param->cb_param.set_attr_value_param.attr_id) {
+			case ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID:
+				on_off_set_value(
+					(zb_bool_t)param->cb_param.set_attr_value_param.values.data8);
+				break;
+			case ZB_ZCL_ATTR_ON_OFF_ON_TIME:
+			case ZB_ZCL_ATTR_ON_OFF_OFF_WAIT_TIME:
+				on_off_timed_write(
+					param->cb_param.set_attr_value_param.attr_id,
+					param->cb_param.set_attr_value_param.values.data16);
+				break;
+			default:
+				break;
+			}
+#ifdef LIGHT_ROLE_SLEEPY
+		} else if (param->cb_param.set_attr_value_param.cluster_id ==
+			   ZB_ZCL_CLUSTER_ID_POLL_CONTROL) {
+			poll_control_write(&param->cb_param.set_attr_value_param);
+#endif
 		} else if (param->cb_param.set_attr_value_param.cluster_id ==
 			   ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL) {
 			level_control_set_value(
@@ -1417,13 +6201,12 @@ static void zcl_device_cb(zb_bufid_t bufid)
 		break;
 
 	case ZB_ZCL_IDENTIFY_EFFECT_CB_ID:
-		start_identify_effect(
-			param->cb_param.identify_effect_value_param.effect_id);
+		light_cmd_effect(param->cb_param.identify_effect_value_param.effect_id);
 		break;
 
 #ifdef CONFIG_ZIGBEE_FOTA
 	case ZB_ZCL_OTA_UPGRADE_VALUE_CB_ID:
-		zigbee_fota_zcl_cb(bufid);
+		ota_zcl_cb(bufid);
 		break;
 #endif
 
@@ -1433,15 +6216,14 @@ static void zcl_device_cb(zb_bufid_t bufid)
 	}
 }
 
-/* Sleepy End Device poll interval in ms (how often to check for messages) */
-#define SED_POLL_INTERVAL_MS 3000
-
 void zboss_signal_handler(zb_bufid_t bufid)
 {
 	zb_zdo_app_signal_hdr_t *sig_hdr = NULL;
 	zb_zdo_app_signal_type_t sig_type = zb_get_app_signal(bufid, &sig_hdr);
 	zb_ret_t status = ZB_GET_APP_SIGNAL_STATUS(bufid);
 
+	prof_event(PROF_ZBOSS);
+
 	/* Update status LED */
 	update_status_led();
 
@@ -1454,15 +6236,27 @@ void zboss_signal_handler(zb_bufid_t bufid)
 	if (sig_type == ZB_BDB_SIGNAL_DEVICE_FIRST_START ||
 	    sig_type == ZB_BDB_SIGNAL_DEVICE_REBOOT) {
 		if (status == RET_OK) {
-			/* Set poll interval for sleepy end device */
-			zb_zdo_pim_set_long_poll_interval(SED_POLL_INTERVAL_MS);
-			LOG_INF("Sleepy End Device: poll interval %d ms", SED_POLL_INTERVAL_MS);
+			/* Adaptive poll interval for sleepy end device */
+			poll_controller_start();
 
+#ifndef LIGHT_ROLE_ROUTER
 			/* Start battery reporting now that we've joined */
+			battery_configure_reporting();
 			battery_start_reporting();
+#endif
 		}
 	}
 
+	if (sig_type == ZB_BDB_SIGNAL_FINDING_AND_BINDING_TARGET_FINISHED) {
+		fb_target_finished(status);
+	}
+
+	/* ZBOSS forgets its group table on leave, so must the cache */
+	if ((sig_type == ZB_ZDO_SIGNAL_LEAVE && status == RET_OK) ||
+	    (sig_type == ZB_BDB_SIGNAL_DEVICE_FIRST_START && status == RET_OK)) {
+		group_cache_clear();
+	}
+
 	/* Use default signal handler */
 	ZB_ERROR_CHECK(zigbee_default_signal_handler(bufid));
 
@@ -1479,6 +6273,14 @@ static int hardware_init(void)
 {
 	int ret;
 
+	/* Light and I/O work queues, before anything can queue work */
+	wq_init();
+	k_work_init_delayable(&light_save_work, light_save_work_handler);
+	k_work_init(&group_save_work, group_save_work_handler);
+	k_work_init(&scene_save_work, scene_save_work_handler);
+	k_work_init_delayable(&light_cmd_work, light_cmd_work_handler);
+	k_work_init(&light_reapply_work, light_reapply_work_handler);
+
 	/* PWM */
 	if (!device_is_ready(pwm_brightness.dev)) {
 		LOG_ERR("PWM device not ready");
@@ -1493,12 +6295,7 @@ static int hardware_init(void)
 	}
 
 	/* Status LED */
-	if (device_is_ready(status_led.port)) {
-		ret = gpio_pin_configure_dt(&status_led, GPIO_OUTPUT_INACTIVE);
-		if (ret < 0) {
-			LOG_WRN("Status LED config failed: %d", ret);
-		}
-	}
+	status_led_init();
 
 	/* Button */
 	ret = button_init();
@@ -1506,17 +6303,25 @@ static int hardware_init(void)
 		return ret;
 	}
 
+#ifndef LIGHT_ROLE_ROUTER
 	/* Battery measurement */
 	ret = battery_init();
 	if (ret < 0) {
 		LOG_WRN("Battery init failed: %d (continuing without battery)", ret);
 		/* Don't fail - battery is optional */
 	}
+#endif
 
 	/* Initialize work items */
 	k_work_init_delayable(&effect_work, effect_work_handler);
-	k_work_init_delayable(&status_led_work, status_led_work_handler);
 	k_work_init_delayable(&transition_work, transition_work_handler);
+	k_work_init_delayable(&timed_off_work, timed_off_work_handler);
+	k_work_init_delayable(&energy_work, energy_work_handler);
+	k_work_schedule(&energy_work, K_SECONDS(ENERGY_REFRESH_SEC));
+#ifdef LIGHT_ROLE_SLEEPY
+	k_work_init_delayable(&poll_work, poll_work_handler);
+	k_work_init_delayable(&poll_checkin_work, poll_checkin_work_handler);
+#endif
 
 	/* Start with light off */
 	light_set_brightness(0);
@@ -1573,6 +6378,15 @@ int main(void)
 	/* Register device context */
 	ZB_AF_REGISTER_DEVICE_CTX(&light_ctx);
 
+	/* Intercept light endpoint commands handled locally (e.g. timed off) */
+	ZB_AF_SET_ENDPOINT_HANDLER(LIGHT_ENDPOINT, light_ep_handler);
+
+	/* Visual feedback while identifying (F&B, Identify command) */
+	ZB_AF_SET_IDENTIFY_NOTIFICATION_HANDLER(LIGHT_ENDPOINT, identify_notify_cb);
+
+	/* Filter group frames against the membership cache */
+	zb_af_set_data_indication(aps_data_indication_cb);
+
 	/* Initialize cluster attributes */
 	clusters_attr_init();
 
@@ -1581,19 +6395,33 @@ int main(void)
 	if (err) {
 		LOG_ERR("Settings load failed: %d", err);
 	}
+	group_filter_rebuild();
+
+	/* Wakeup / residency profiling */
+	prof_init();
+
+#if defined(CONFIG_APP_POWER_SOURCE_DETECT) && !defined(LIGHT_ROLE_ROUTER)
+	/* USB VBUS vs battery, updates Basic PowerSource */
+	power_source_init();
+#endif
 
 	/* Apply startup behavior based on configuration */
 	apply_startup_behavior();
 
-	LOG_INF("Hold button 3s to reset/pair");
+	LOG_INF("Hold button %us to reset/pair", BUTTON_RESET_HOLD_MS / 1000U);
 	LOG_INF("Starting Zigbee stack...");
 
+#ifndef LIGHT_ROLE_ROUTER
+	/* ED_AGING_TIMEOUT_64MIN = parent keeps us in table for 64 min without contact */
+	zb_set_ed_timeout(ED_AGING_TIMEOUT_64MIN);
+#endif
+
+#ifdef LIGHT_ROLE_SLEEPY
 	/* Enable sleepy end device (radio off between polls)
-	 * ED_AGING_TIMEOUT_64MIN = parent keeps us in table for 64 min without contact
 	 * This allows deep sleep while still being reachable for commands
 	 */
-	zb_set_ed_timeout(ED_AGING_TIMEOUT_64MIN);
 	zigbee_configure_sleepy_behavior(true);
+#endif
 
 	/* Start Zigbee stack */
 	zigbee_enable();
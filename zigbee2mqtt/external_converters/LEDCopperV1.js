@@ -1,11 +1,146 @@
-const {light, battery} = require('zigbee-herdsman-converters/lib/modernExtend');
+const {light, battery, electricityMeter, numeric, deviceAddCustomCluster} = require('zigbee-herdsman-converters/lib/modernExtend');
+const {Zcl} = require('zigbee-herdsman');
+
+/* Group cache slots exposed by the firmware (LIGHT_DIAG_GROUP_SLOTS) */
+const GROUP_SLOTS = 8;
+
+const groupAttributes = Object.fromEntries(Array.from({length: GROUP_SLOTS}, (_, i) => [
+    [`group${i}Addr`, {ID: 0x0090 + i, type: Zcl.DataType.UINT16}],
+    [`group${i}Cmds`, {ID: 0x00a0 + i, type: Zcl.DataType.UINT32}],
+    [`group${i}LatencyAvg`, {ID: 0x00b0 + i, type: Zcl.DataType.UINT32}],
+    [`group${i}LatencyMax`, {ID: 0x00c0 + i, type: Zcl.DataType.UINT32}],
+]).flat());
+
+/* Manufacturer-specific diagnostics cluster (see firmware/include/light_diagnostics.h) */
+const diagnosticsCluster = deviceAddCustomCluster('ledCopperDiagnostics', {
+    ID: 0xfc00,
+    attributes: {
+        latencyCount: {ID: 0x0000, type: Zcl.DataType.UINT32},
+        latencyMin: {ID: 0x0001, type: Zcl.DataType.UINT32},
+        latencyAvg: {ID: 0x0002, type: Zcl.DataType.UINT32},
+        latencyMax: {ID: 0x0003, type: Zcl.DataType.UINT32},
+        latencyP99: {ID: 0x0004, type: Zcl.DataType.UINT32},
+        latencyZclAvg: {ID: 0x0005, type: Zcl.DataType.UINT32},
+        latencyLevelAvg: {ID: 0x0006, type: Zcl.DataType.UINT32},
+        pollInterval: {ID: 0x0010, type: Zcl.DataType.UINT32},
+        pollFastEntries: {ID: 0x0011, type: Zcl.DataType.UINT32},
+        pollFastTime: {ID: 0x0012, type: Zcl.DataType.UINT32},
+        energyLed: {ID: 0x0020, type: Zcl.DataType.UINT32},
+        energyMcu: {ID: 0x0021, type: Zcl.DataType.UINT32},
+        energyRadio: {ID: 0x0022, type: Zcl.DataType.UINT32},
+        energyPerDay: {ID: 0x0023, type: Zcl.DataType.UINT32},
+        sleepPermille: {ID: 0x0030, type: Zcl.DataType.UINT16},
+        wakeupsPerHour: {ID: 0x0031, type: Zcl.DataType.UINT32},
+        pmEntries: {ID: 0x0032, type: Zcl.DataType.UINT32},
+        wakeupsPolarity: {ID: 0x0040, type: Zcl.DataType.UINT32},
+        wakeupsTransition: {ID: 0x0041, type: Zcl.DataType.UINT32},
+        wakeupsEffect: {ID: 0x0042, type: Zcl.DataType.UINT32},
+        wakeupsBattery: {ID: 0x0043, type: Zcl.DataType.UINT32},
+        wakeupsStatusLed: {ID: 0x0044, type: Zcl.DataType.UINT32},
+        wakeupsButton: {ID: 0x0045, type: Zcl.DataType.UINT32},
+        wakeupsPoll: {ID: 0x0046, type: Zcl.DataType.UINT32},
+        wakeupsZboss: {ID: 0x0047, type: Zcl.DataType.UINT32},
+        activePolarity: {ID: 0x0050, type: Zcl.DataType.UINT32},
+        activeTransition: {ID: 0x0051, type: Zcl.DataType.UINT32},
+        activeEffect: {ID: 0x0052, type: Zcl.DataType.UINT32},
+        activeBattery: {ID: 0x0053, type: Zcl.DataType.UINT32},
+        activeStatusLed: {ID: 0x0054, type: Zcl.DataType.UINT32},
+        activeButton: {ID: 0x0055, type: Zcl.DataType.UINT32},
+        activePoll: {ID: 0x0056, type: Zcl.DataType.UINT32},
+        activeZboss: {ID: 0x0057, type: Zcl.DataType.UINT32},
+        lightWqLatencyMax: {ID: 0x0060, type: Zcl.DataType.UINT32},
+        lightWqLatencyAvg: {ID: 0x0061, type: Zcl.DataType.UINT32},
+        lightWqStackUnused: {ID: 0x0062, type: Zcl.DataType.UINT32},
+        ioWqLatencyMax: {ID: 0x0063, type: Zcl.DataType.UINT32},
+        ioWqLatencyAvg: {ID: 0x0064, type: Zcl.DataType.UINT32},
+        ioWqStackUnused: {ID: 0x0065, type: Zcl.DataType.UINT32},
+        cmdCoalesced: {ID: 0x0070, type: Zcl.DataType.UINT32},
+        cmdDropped: {ID: 0x0071, type: Zcl.DataType.UINT32},
+        reportFrames: {ID: 0x0072, type: Zcl.DataType.UINT32},
+        reportAttrs: {ID: 0x0073, type: Zcl.DataType.UINT32},
+        otaRate: {ID: 0x0080, type: Zcl.DataType.UINT32},
+        otaEta: {ID: 0x0081, type: Zcl.DataType.UINT32},
+        otaOffset: {ID: 0x0082, type: Zcl.DataType.UINT32},
+        ...groupAttributes,
+    },
+    commands: {},
+    commandsResponse: {},
+});
+
+const diagnostic = (name, attribute, description, unit) => numeric({
+    name,
+    cluster: 'ledCopperDiagnostics',
+    attribute,
+    description,
+    unit,
+    access: 'STATE_GET',
+    entityCategory: 'diagnostic',
+    reporting: false,
+});
 
 const definition = {
     zigbeeModel: ['LEDCopperV1'],
     model: 'LEDCopperV1',
     vendor: 'DIY',
     description: 'LED Copper String Light with Battery',
-    extend: [light(), battery()],
+    extend: [
+        light(),
+        battery(),
+        electricityMeter({cluster: 'metering'}),
+        diagnosticsCluster,
+        diagnostic('latency_count', 'latencyCount', 'Commands measured'),
+        diagnostic('latency_min', 'latencyMin', 'Command-to-light latency, minimum', 'µs'),
+        diagnostic('latency_avg', 'latencyAvg', 'Command-to-light latency, average', 'µs'),
+        diagnostic('latency_max', 'latencyMax', 'Command-to-light latency, maximum', 'µs'),
+        diagnostic('latency_p99', 'latencyP99', 'Command-to-light latency, 99th percentile', 'µs'),
+        diagnostic('latency_zcl_avg', 'latencyZclAvg', 'APS indication to ZCL callback, average', 'µs'),
+        diagnostic('latency_level_avg', 'latencyLevelAvg', 'APS indication to level set, average', 'µs'),
+        diagnostic('poll_interval', 'pollInterval', 'Current poll interval', 'ms'),
+        diagnostic('poll_fast_entries', 'pollFastEntries', 'Times fast polling was entered'),
+        diagnostic('poll_fast_time', 'pollFastTime', 'Total time spent polling faster than idle', 's'),
+        diagnostic('energy_led', 'energyLed', 'Modelled LED energy since boot', 'mWh'),
+        diagnostic('energy_mcu', 'energyMcu', 'Modelled MCU energy since boot', 'mWh'),
+        diagnostic('energy_radio', 'energyRadio', 'Modelled radio energy since boot', 'mWh'),
+        diagnostic('energy_per_day', 'energyPerDay', 'Average energy per day since boot', 'mWh'),
+        diagnostic('sleep_permille', 'sleepPermille', 'Time spent asleep since boot', '‰'),
+        diagnostic('wakeups_per_hour', 'wakeupsPerHour', 'Average wakeups per hour since boot'),
+        diagnostic('pm_entries', 'pmEntries', 'Low-power state entries since boot'),
+        diagnostic('wakeups_polarity', 'wakeupsPolarity', 'Wakeups from polarity timer since boot'),
+        diagnostic('wakeups_transition', 'wakeupsTransition', 'Wakeups from fade steps since boot'),
+        diagnostic('wakeups_effect', 'wakeupsEffect', 'Wakeups from identify effects since boot'),
+        diagnostic('wakeups_battery', 'wakeupsBattery', 'Wakeups from battery sampling since boot'),
+        diagnostic('wakeups_status_led', 'wakeupsStatusLed', 'Wakeups from status LED since boot'),
+        diagnostic('wakeups_button', 'wakeupsButton', 'Wakeups from button since boot'),
+        diagnostic('wakeups_poll', 'wakeupsPoll', 'Wakeups from poll control since boot'),
+        diagnostic('wakeups_zboss', 'wakeupsZboss', 'Wakeups from Zigbee stack since boot'),
+        diagnostic('active_polarity', 'activePolarity', 'Active time in polarity timer since boot', 'µs'),
+        diagnostic('active_transition', 'activeTransition', 'Active time in fade steps since boot', 'µs'),
+        diagnostic('active_effect', 'activeEffect', 'Active time in identify effects since boot', 'µs'),
+        diagnostic('active_battery', 'activeBattery', 'Active time in battery sampling since boot', 'µs'),
+        diagnostic('active_status_led', 'activeStatusLed', 'Active time in status LED since boot', 'µs'),
+        diagnostic('active_button', 'activeButton', 'Active time in button since boot', 'µs'),
+        diagnostic('active_poll', 'activePoll', 'Active time in poll control since boot', 'µs'),
+        diagnostic('active_zboss', 'activeZboss', 'Active time in Zigbee stack since boot', 'µs'),
+        diagnostic('light_wq_latency_max', 'lightWqLatencyMax', 'Light work queue delay, maximum', 'µs'),
+        diagnostic('light_wq_latency_avg', 'lightWqLatencyAvg', 'Light work queue delay, average', 'µs'),
+        diagnostic('light_wq_stack_unused', 'lightWqStackUnused', 'Light work queue unused stack', 'B'),
+        diagnostic('io_wq_latency_max', 'ioWqLatencyMax', 'I/O work queue delay, maximum', 'µs'),
+        diagnostic('io_wq_latency_avg', 'ioWqLatencyAvg', 'I/O work queue delay, average', 'µs'),
+        diagnostic('io_wq_stack_unused', 'ioWqStackUnused', 'I/O work queue unused stack', 'B'),
+        diagnostic('cmd_coalesced', 'cmdCoalesced', 'Level commands merged into a later one'),
+        diagnostic('cmd_dropped', 'cmdDropped', 'Light commands dropped on a full queue'),
+        diagnostic('report_frames', 'reportFrames', 'Batched Report Attributes frames sent'),
+        diagnostic('report_attrs', 'reportAttrs', 'Attributes carried in batched reports'),
+        diagnostic('ota_rate', 'otaRate', 'OTA download throughput', 'B/s'),
+        diagnostic('ota_eta', 'otaEta', 'OTA download time left', 's'),
+        diagnostic('ota_offset', 'otaOffset', 'OTA bytes downloaded', 'B'),
+        ...Array.from({length: GROUP_SLOTS}, (_, i) => [
+            diagnostic(`group${i}_addr`, `group${i}Addr`, `Group slot ${i}: group ID (65535 = unused)`),
+            diagnostic(`group${i}_cmds`, `group${i}Cmds`, `Group slot ${i}: commands measured`),
+            diagnostic(`group${i}_latency_avg`, `group${i}LatencyAvg`, `Group slot ${i}: command-to-light latency, average`, 'µs'),
+            diagnostic(`group${i}_latency_max`, `group${i}LatencyMax`, `Group slot ${i}: command-to-light latency, maximum`, 'µs'),
+        ]).flat(),
+    ],
     icon: 'https://i.imgur.com/t8u7H0D.png',
 };
 